@@ -19,8 +19,20 @@
  * Functions with prefix "apl" follow the conventions for APL tables.
  */
 
+#ifndef _WIN32
+#define _GNU_SOURCE    /* dladdr */
+#include <dlfcn.h>
+#endif
+#include <ctype.h>
+#include <signal.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#ifndef APL_NO_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
 
 #include "lua.h"
 #include "lauxlib.h"
@@ -232,6 +244,235 @@ static int core_is_int(lua_State *L) {
   return 1;
 }
 
+/* hash(s): 64-bit FNV-1a hash of the string s, as 16 hex digits */
+static int core_hash(lua_State *L) {
+  size_t l;
+  const unsigned char *s=(const unsigned char *)luaL_checklstring(L,1,&l);
+  unsigned long long h=14695981039346656037ULL;
+  char buf[17];
+  while (l--) { h^=*s++; h*=1099511628211ULL; }
+  sprintf(buf,"%016llx",h);
+  lua_pushstring(L,buf);
+  return 1;
+}
+
+/* ------------------ Memory accounting package ----------------------- */
+
+/* The allocator of the Lua state is wrapped so that the bytes in use and
+   their peak are known exactly. Scratch buffers are Lua userdata, so the
+   collector already paces itself by their size. The wrapper is only 
+   installed when accounting or a limit is first asked for, and removed
+   by the __gc of a sentinel in the registry, which lua_close runs before
+   the shared library is unloaded. If the host has installed another 
+   allocator on top of it meanwhile, the wrapper stays. */
+typedef struct {
+  lua_Alloc f;
+  void *ud;
+  size_t used, peak, limit;                        /* limit 0: none */
+} apl_memory;
+
+static void *mem_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+  apl_memory *M=(apl_memory *)ud;
+  void *p=M->f(M->ud,ptr,osize,nsize);
+  if (ptr==NULL) osize=0;            /* osize is then a type tag */
+  if (p!=NULL || nsize==0) {
+    M->used += nsize; M->used -= osize;
+    if (M->used>M->peak) M->peak=M->used;
+  }
+  return p;
+}
+
+static apl_memory *mem_state(lua_State *L) {
+  void *ud;
+  return lua_getallocf(L,&ud)==mem_alloc ? (apl_memory *)ud : NULL;
+}
+
+/* The wrapper stays in use, so lua_close must not unload its code. */
+static void mem_pin(void) {
+#ifndef _WIN32
+  Dl_info info;
+  if (dladdr((void *)mem_alloc,&info) && info.dli_fname) 
+    dlopen(info.dli_fname,RTLD_NOW);
+#endif
+}
+
+static int mem_close(lua_State *L) {
+  apl_memory **MM=(apl_memory **)lua_touserdata(L,1);
+  if (*MM && mem_state(L)==*MM) {   /* still the allocator of the state */
+    lua_setallocf(L,(*MM)->f,(*MM)->ud); 
+    free(*MM); 
+    *MM=NULL;
+  } else if (*MM) mem_pin();
+  return 0;
+}
+
+static apl_memory *mem_init(lua_State *L) {
+  apl_memory *M, **MM;
+  if ((M=mem_state(L))) return M;
+  if (!(M=(apl_memory *)malloc(sizeof(apl_memory)))) return NULL;
+  MM=(apl_memory **)lua_newuserdata(L,sizeof(apl_memory *));
+  *MM=M;
+  lua_createtable(L,0,1);
+  lua_pushcfunction(L,mem_close);
+  lua_setfield(L,-2,"__gc");
+  lua_setmetatable(L,-2);
+  lua_setfield(L,LUA_REGISTRYINDEX,"apl_memory");
+  M->f=lua_getallocf(L,&M->ud);
+  M->limit=0;
+  M->used=M->peak=
+    (size_t)lua_gc(L,LUA_GCCOUNT,0)*1024+lua_gc(L,LUA_GCCOUNTB,0);
+  lua_setallocf(L,mem_alloc,M);
+  return M;
+}
+
+/* Estimated sizes of Lua 5.2 objects on a 64-bit machine */
+#define MEM_TABLE 56
+#define MEM_TVALUE 16
+#define MEM_NODE 40
+#define MEM_STRING 25
+#define MEM_UDATA 40
+
+/* Raises an error if `bytes` more would take the memory in use past the
+   soft limit, even after a full garbage collection */
+static void mem_check(lua_State *L, size_t bytes) {
+  apl_memory *M=mem_state(L);
+  if (M==NULL || M->limit==0 || M->used+bytes<=M->limit) return;
+  lua_gc(L,LUA_GCCOLLECT,0);
+  if (M->used+bytes>M->limit) luaL_error(L,
+    "workspace full: %d KB more would exceed the limit of %d KB",
+    (int)(bytes>>10),(int)(M->limit>>10));
+}
+
+/* memory([limit]): bytes in use, their peak since the last reset, and
+   the soft limit. A number sets the limit (0 for none), "reset" sets the
+   peak to the bytes in use. Accounting starts with the first call, 
+   except for memory(0) and memory"limit", which only return the limit. */
+static int mem_memory(lua_State *L) {
+  static const char *const opts[] = {"reset","limit",NULL};
+  apl_memory *M=mem_state(L);
+  lua_Number n=0;
+  int opt=-1;
+  if (lua_type(L,1)==LUA_TSTRING) opt=luaL_checkoption(L,1,NULL,opts);
+  else if (!lua_isnoneornil(L,1)) {
+    n=luaL_checknumber(L,1);
+    luaL_argcheck(L,n>=0,1,"must be non-negative");
+  }
+  if (M==NULL && (opt==1 || (opt<0 && n==0 && !lua_isnoneornil(L,1)))) {
+    lua_pushnil(L);
+    return 1;
+  }
+  if (opt==1) {
+    if (M->limit) lua_pushnumber(L,(lua_Number)M->limit); else lua_pushnil(L);
+    return 1;
+  }
+  if (M==NULL && (M=mem_init(L))==NULL) 
+    return luaL_error(L,"memory accounting is not available");
+  if (opt==0) M->peak=M->used;
+  else if (!lua_isnoneornil(L,1)) M->limit=(size_t)n;
+  lua_pushnumber(L,(lua_Number)M->used);
+  lua_pushnumber(L,(lua_Number)M->peak);
+  if (M->limit) lua_pushnumber(L,(lua_Number)M->limit); else lua_pushnil(L);
+  return 3;
+}
+
+#define MEM_NUMBER 1
+#define MEM_CHAR 2
+#define MEM_NESTED 4
+
+/* Estimated bytes taken by the value at `idx` (absolute), counting the
+   tables, strings and userdata not yet keys of the table at `seen`, and
+   making them keys. If `kind` is not NULL, the types of the items of a
+   table are or'ed into it. */
+static size_t mem_size(lua_State *L, int idx, int seen, int *kind) {
+  size_t bytes, len;
+  int t=lua_type(L,idx);
+  if (t!=LUA_TSTRING && t!=LUA_TTABLE && t!=LUA_TUSERDATA) return 0;
+  lua_pushvalue(L,idx); lua_rawget(L,seen);
+  if (lua_toboolean(L,-1)) { lua_pop(L,1); return 0; }
+  lua_pop(L,1);
+  lua_pushvalue(L,idx); lua_pushboolean(L,1); lua_rawset(L,seen);
+  if (t==LUA_TSTRING) { lua_tolstring(L,idx,&len); return MEM_STRING+len; }
+  if (t==LUA_TUSERDATA) return MEM_UDATA+lua_rawlen(L,idx);
+  luaL_checkstack(L,4,"array nested too deeply");
+  len=lua_rawlen(L,idx);
+  bytes=MEM_TABLE+len*MEM_TVALUE;
+  lua_pushnil(L);
+  while (lua_next(L,idx)) {
+    int top=lua_gettop(L);
+    lua_Number k=lua_type(L,-2)==LUA_TNUMBER ? lua_tonumber(L,-2) : 0;
+    if (k>=1 && k<=len && k==floor(k)) {
+      if (kind) *kind |= lua_type(L,top)==LUA_TNUMBER ? MEM_NUMBER :
+         lua_type(L,top)==LUA_TSTRING ? MEM_CHAR : MEM_NESTED;
+    } else bytes+=MEM_NODE;     /* keys like "rows" are interned anyway */
+    bytes+=mem_size(L,top,seen,NULL);
+    lua_pop(L,1);
+  }
+  return bytes;
+}
+
+/* sizeof(x[,seen]): estimated bytes taken by x, and its representation: 
+   "number", "character", "mixed", "nested", "sparse", "stream", "text"
+   or the Lua type. What is already a key of the table `seen` is not counted
+   again, and what is counted becomes a key. */
+static int mem_sizeof(lua_State *L) {
+  int kind=0;
+  const char *rep;
+  luaL_checkany(L,1);
+  if (lua_isnoneornil(L,2)) { lua_settop(L,1); lua_newtable(L); }
+  else { luaL_checktype(L,2,LUA_TTABLE); lua_settop(L,2); }
+  lua_pushnumber(L,(lua_Number)mem_size(L,1,2,&kind));
+  if (luaL_testudata(L,1,"apl_sparse")) rep="sparse";
+  else if (luaL_testudata(L,1,"apl_stream")) rep="stream";
+  else if (luaL_testudata(L,1,"apl_text")) rep="text";
+  else if (!lua_istable(L,1)) rep=luaL_typename(L,1);
+  else if (kind&MEM_NESTED) rep="nested";
+  else if (kind==(MEM_NUMBER|MEM_CHAR)) rep="mixed";
+  else if (kind==MEM_CHAR) rep="character";
+  else rep="number";
+  lua_pushstring(L,rep);
+  return 2;
+}
+
+/* -------------------- Interrupts and progress ----------------------- */
+
+/* Long loops run in slices of APL_SLICE items. Between slices they look
+   at `apl_interrupted`, which a signal handler may set (the registry 
+   holds its address as light userdata "apl_interrupt"). Loops that call
+   Lua anyway (each, both) also call the progress function in the 
+   registry, if any, with a continuation, so that it may yield. Numeric
+   kernels have none, so they only look at the flag. */
+#define APL_SLICE 65536
+
+static volatile sig_atomic_t apl_interrupted = 0;
+
+static void apl_checkinterrupt(lua_State *L) {
+  if (apl_interrupted) { apl_interrupted=0; luaL_error(L,"interrupted!"); }
+}
+
+/* Calls progress(done,total) via lua_callk with continuation k and ctx
+   after checking for an interrupt */
+static void apl_slice(lua_State *L, long done, long total, int ctx,
+    lua_CFunction k) {
+  apl_checkinterrupt(L);
+  lua_getfield(L,LUA_REGISTRYINDEX,"apl_progress");
+  if (lua_isnil(L,-1)) { lua_pop(L,1); return; }
+  lua_pushnumber(L,(lua_Number)done); 
+  lua_pushnumber(L,(lua_Number)total);
+  lua_callk(L,2,0,ctx,k);
+}
+
+/* progress([f]): sets the progress function (nil for none) when called
+   with an argument; returns the progress function */
+static int apl_setprogress(lua_State *L) {
+  if (lua_gettop(L)>0) {
+    if (!lua_isnil(L,1)) luaL_checktype(L,1,LUA_TFUNCTION);
+    lua_settop(L,1);
+    lua_setfield(L,LUA_REGISTRYINDEX,"apl_progress");
+  }
+  lua_getfield(L,LUA_REGISTRYINDEX,"apl_progress");
+  return 1;
+}
+
 /* -------------------- core APL package ----------------------- */
 
 /* An APL array `A` is a Lua table with
@@ -239,6 +480,8 @@ static int core_is_int(lua_State *L) {
  * - A.apl_len = length at creation
  * - A.rows = number of rows (matrix only)
  * - A.cols = number of columns (matrix only)  
+ * - A.shape = APL vector of the extents (rank 3 and more only, never 
+ *      modified, so that arrays of the same shape may share it)
  * - A.apl_qr = a table or userdata containing the QR factorization 
  *      (numeric matrix which is unchanged since last fatorizion only)
  */
@@ -255,6 +498,7 @@ static int core_is_int(lua_State *L) {
   lua_pushstring(L,key); lua_rawset(L,tbl);
 static void core_new(lua_State *L, int len, int init) {
   int i, tbl=lua_gettop(L)+1;
+  mem_check(L,MEM_TABLE+(size_t)len*MEM_TVALUE);
   lua_createtable(L,len,3);
   lua_pushinteger(L,len);
   lua_setfield(L,tbl,"apl_len");
@@ -265,6 +509,70 @@ static void core_new(lua_State *L, int len, int init) {
   apl_setmetatable(L,tbl);
 }   
 
+/* UTF-8. A codepoint is a lead byte followed by the continuation bytes
+   it announces, as in the LPeg grammar of apl.lua; any other byte 
+   counts as a codepoint by itself. */
+
+/* length in bytes of the codepoint starting at s, with s<e */
+static size_t utf_step(const unsigned char *s, const unsigned char *e) {
+  size_t k, n = *s<0xC0 ? 1 : *s<0xE0 ? 2 : *s<0xF0 ? 3 : *s<0xF8 ? 4 :
+    *s<0xFE ? 5 : 1;
+  if ((size_t)(e-s)<n) return 1;
+  for (k=1; k<n; k++) if ((s[k]&0xC0)!=0x80) return 1;
+  return n;
+}
+
+static int utf_count(const unsigned char *s, size_t l) {
+  const unsigned char *e=s+l;
+  int n=0;
+  while (s<e) { s+=utf_step(s,e); n++; }
+  return n;
+}
+
+/* utflen(s): number of codepoints in s */
+static int core_utflen(lua_State *L) {
+  size_t l;
+  const char *s=luaL_checklstring(L,1,&l);
+  lua_pushinteger(L,utf_count((const unsigned char *)s,l));
+  return 1;
+}
+
+/* utfsplit(s): APL array of the codepoints in s, as strings */
+static int core_utfsplit(lua_State *L) {
+  size_t l, k;
+  const unsigned char *s=(const unsigned char *)luaL_checklstring(L,1,&l), 
+    *e=s+l;
+  int i, n=utf_count(s,l);
+  lua_settop(L,1);
+  core_new(L,n,0);
+  for (i=1; s<e; i++) {
+    k=utf_step(s,e);
+    lua_pushlstring(L,(const char *)s,k);
+    lua_rawseti(L,2,i);
+    s+=k;
+  }
+  return 1;
+}
+
+/* utfsub(s,i[,j]): codepoints i to j of s, counting like string.sub */
+static int core_utfsub(lua_State *L) {
+  size_t l;
+  const unsigned char *s=(const unsigned char *)luaL_checklstring(L,1,&l), 
+    *e=s+l, *p;
+  int i=luaL_checkint(L,2), j=luaL_optint(L,3,-1), n=0, k;
+  if (i<0 || j<0) {
+    n=utf_count(s,l);
+    if (i<0) i+=n+1;
+    if (j<0) j+=n+1;
+  }
+  if (i<1) i=1;
+  if (j<i) { lua_pushliteral(L,""); return 1; }
+  for (k=1; k<i && s<e; k++) s+=utf_step(s,e);
+  for (p=s; k<=j && p<e; k++) p+=utf_step(p,e);
+  lua_pushlstring(L,(const char *)s,p-s);
+  return 1;
+}
+
 /* analogue of luaL_len, interrogates `apl_len` first */
 static int aplL_len(lua_State *L, int tbl) {
   int l;
@@ -318,7 +626,8 @@ static int apl_newindex(lua_State *L) {
   else lua_pop(L,1);
 #define apl_cloneshape(L,tbl,source,target) \
    if (tbl) { apl_clonefield(L,source,target,"rows"); \
-              apl_clonefield(L,source,target,"cols"); }
+              apl_clonefield(L,source,target,"cols"); \
+              apl_clonefield(L,source,target,"shape"); }
 
 /* stripped-down reshape: rho(v,n) makes an n-vector, rho(v,m,n) an
    m×n matrix, filled copies of v, whatever v is */
@@ -359,10 +668,334 @@ static int apl_iota(lua_State *L) {
   return 1;
 }
 
+/* Arrays of any rank. Items are stored in row-major order, so that the 
+   stride of an axis is the product of the extents of the later axes. */
+
+#define APL_MAXRANK 32
+
+/* Stores the extents of the array at idx in dims and returns its rank */
+static int nd_dims(lua_State *L, int idx, int *dims) {
+  int i, r, len, m=-1, n=-1;
+  apl_getfield(L,idx,"shape");
+  if (lua_istable(L,-1)) {
+    r=luaL_len(L,-1);
+    luaL_argcheck(L,r<=APL_MAXRANK,idx,"rank too high");
+    for (i=0; i<r; i++) { 
+      lua_rawgeti(L,-1,i+1); dims[i]=lua_tointeger(L,-1); lua_pop(L,1); 
+    }
+    lua_pop(L,1);
+    return r;
+  }
+  lua_pop(L,1);
+  apl_getshapeinfo(idx,len,m,n);
+  if (n>=0) { dims[0]=m; dims[1]=n; return 2; }
+  dims[0]=len; 
+  return 1;
+}
+
+/* Gives the table at res the given extents: none for a vector, rows 
+   and cols for a matrix, shape for higher ranks */
+static void nd_setshape(lua_State *L, int res, int r, const int *dims) {
+  int i;
+  if (r==2) { 
+    lua_pushstring(L,"rows"); lua_pushinteger(L,dims[0]); lua_rawset(L,res); 
+    lua_pushstring(L,"cols"); lua_pushinteger(L,dims[1]); lua_rawset(L,res); 
+  } else if (r>2) {
+    lua_pushstring(L,"shape");
+    core_new(L,r,0);
+    for (i=0; i<r; i++) { lua_pushinteger(L,dims[i]); lua_rawseti(L,-2,i+1); }
+    lua_rawset(L,res);
+  }
+}
+
+/* strided(a,sel[,perm[,fill]]): subarray of an array of any rank. Axis
+   i of the result is taken from axis perm[i] of a (default i) at the 
+   positions in sel[i]: a table of 1-based positions, 0 standing for 
+   `fill` (default 0), or a single position, which drops the axis. Used 
+   for indexing, transposition, Take and Drop. */
+static int nd_strided(lua_State *L) {
+  int dims[APL_MAXRANK], ext[APL_MAXRANK], perm[APL_MAXRANK], 
+    pos[APL_MAXRANK], used[APL_MAXRANK];
+  long stride[APL_MAXRANK], *off[APL_MAXRANK], base=0, o;
+  int r, rr=0, i, j, e, p, ax, total=1, res, fill;
+  luaL_checktype(L,1,LUA_TTABLE);
+  luaL_checktype(L,2,LUA_TTABLE);
+  lua_settop(L,4);
+  if (lua_isnil(L,4)) { lua_pushinteger(L,0); lua_replace(L,4); }
+  r=nd_dims(L,1,dims);
+  luaL_argcheck(L,luaL_len(L,2)==r,2,"expected one selection per axis");
+  luaL_checkstack(L,r+4,"rank too high");
+  for (i=r-1, o=1; i>=0; i--) { stride[i]=o; o*=dims[i]; used[i]=0; }
+  for (i=0; i<r; i++) perm[i]=i;
+  if (lua_istable(L,3)) {
+    luaL_argcheck(L,luaL_len(L,3)==r,3,"expected one entry per axis");
+    for (i=0; i<r; i++) {
+      lua_rawgeti(L,3,i+1); ax=lua_tointeger(L,-1)-1; lua_pop(L,1);
+      luaL_argcheck(L,ax>=0 && ax<r && !used[ax],3,"not a permutation");
+      perm[i]=ax; used[ax]=1;
+    }
+  }
+  for (i=0; i<r; i++) {
+    ax=perm[i];
+    lua_rawgeti(L,2,i+1);
+    if (lua_istable(L,-1)) {
+      e=luaL_len(L,-1);
+      off[rr]=(long *)lua_newuserdata(L,e*sizeof(long)+1);
+      for (j=0; j<e; j++) {
+        lua_rawgeti(L,-2,j+1); p=lua_tointeger(L,-1);
+        luaL_argcheck(L,lua_type(L,-1)==LUA_TNUMBER && p>=0 && p<=dims[ax],
+          2,"index out of range");
+        lua_pop(L,1);
+        off[rr][j] = p ? (p-1)*stride[ax] : -1;
+      }
+      lua_remove(L,-2);  /* keep the offsets, drop the selection */
+      ext[rr++]=e; total*=e;
+    } else {
+      p=lua_tointeger(L,-1);
+      luaL_argcheck(L,lua_type(L,-1)==LUA_TNUMBER && p>=1 && p<=dims[ax],
+        2,"index out of range");
+      lua_pop(L,1);
+      base+=(p-1)*stride[ax];
+    }
+  }
+  if (rr==0) { lua_rawgeti(L,1,base+1); return 1; }
+  core_new(L,total,4);
+  res=lua_gettop(L);
+  for (i=0; i<rr; i++) pos[i]=0;
+  for (j=1; j<=total; j++) {
+    for (i=0, o=base, fill=0; i<rr; i++) {
+      if (off[i][pos[i]]<0) { fill=1; break; }
+      o+=off[i][pos[i]];
+    }
+    if (!fill) { lua_rawgeti(L,1,o+1); lua_rawseti(L,res,j); }
+    for (i=rr-1; i>=0 && ++pos[i]==ext[i]; i--) pos[i]=0;
+  }
+  nd_setshape(L,res,rr,ext);
+  return 1;
+}
+
+/* 1 unless a1 and a2 have different shapes while one of them has rank 3 
+   or more, in which case the extents that differ are stored in k and l */
+static int nd_match(lua_State *L, int a1, int a2, int *k, int *l) {
+  int d1[APL_MAXRANK], d2[APL_MAXRANK], r1, r2, i, nd;
+  apl_getfield(L,a1,"shape"); 
+  apl_getfield(L,a2,"shape");
+  nd = lua_istable(L,-1) || lua_istable(L,-2);
+  lua_pop(L,2);
+  if (!nd) return 1;
+  r1=nd_dims(L,a1,d1); r2=nd_dims(L,a2,d2);
+  if (r1!=r2) { *k=r1; *l=r2; return 0; }
+  for (i=0; i<r1; i++) if (d1[i]!=d2[i]) { *k=d1[i]; *l=d2[i]; return 0; }
+  return 1;
+}
+
+/* Texts. A text is a vector of codepoints kept as the UTF-8 bytes of a 
+   string plus the byte offset of every codepoint, so that its length, 
+   its items and its slices take constant time. A slice shares bytes and
+   offsets with the text it was cut from, which its uservalue keeps 
+   alive. */
+
+typedef struct { const char *s; const int *off; int len; } apl_text;
+
+#define text_check(L,idx) ((apl_text *)luaL_checkudata(L,idx,"apl_text"))
+#define text_test(L,idx) ((apl_text *)luaL_testudata(L,idx,"apl_text"))
+#define text_at(T,i) ((T)->s+(T)->off[i])            /* item i, 0-based */
+#define text_size(T,i) ((size_t)((T)->off[(i)+1]-(T)->off[i]))
+
+/* text(s): s as a text; a text is returned unchanged */
+static int text_new(lua_State *L) {
+  size_t l;
+  const unsigned char *s, *e, *p;
+  apl_text *T;
+  int *off, i, n;
+  char *b;
+  if (text_test(L,1)) { lua_settop(L,1); return 1; }
+  s=(const unsigned char *)luaL_checklstring(L,1,&l); e=s+l;
+  luaL_argcheck(L,l<INT_MAX,1,"string too long for a text");
+  n=utf_count(s,l);
+  mem_check(L,sizeof(apl_text)+(n+1)*sizeof(int)+l);
+  T=(apl_text *)lua_newuserdata(L,sizeof(apl_text)+(n+1)*sizeof(int)+l);
+  off=(int *)(T+1); b=(char *)(off+n+1);
+  for (i=0, p=s; p<e; i++) { off[i]=(int)(p-s); p+=utf_step(p,e); }
+  off[n]=(int)l;
+  memcpy(b,s,l);
+  T->s=b; T->off=off; T->len=n;
+  luaL_setmetatable(L,"apl_text");
+  return 1;
+}
+
+/* istext(x): is x a text? */
+static int text_istext(lua_State *L) {
+  lua_pushboolean(L,text_test(L,1)!=NULL);
+  return 1;
+}
+
+/* textsub(t,i[,j]): items i to j of the text t, counting like string.sub,
+   as a text that shares storage with t */
+static int text_sub(lua_State *L) {
+  apl_text *T=text_check(L,1), *V;
+  int i=luaL_checkint(L,2), j=luaL_optint(L,3,-1), n=T->len;
+  if (i<0) i+=n+1;
+  if (j<0) j+=n+1;
+  if (i<1) i=1;
+  if (j>n) j=n;
+  if (j<i) { i=1; j=0; }
+  V=(apl_text *)lua_newuserdata(L,sizeof(apl_text));
+  V->s=T->s; V->off=T->off+i-1; V->len=j-i+1;
+  luaL_setmetatable(L,"apl_text");
+  lua_createtable(L,1,0);
+  lua_getuservalue(L,1);         /* the owner of the storage of t */
+  if (lua_istable(L,-1)) lua_rawgeti(L,-1,1); else lua_pushvalue(L,1);
+  lua_rawseti(L,-3,1);
+  lua_pop(L,1);
+  lua_setuservalue(L,-2);
+  return 1;
+}
+
+/* apl_text.__len */
+static int text_len(lua_State *L) {
+  lua_pushinteger(L,text_check(L,1)->len);
+  return 1;
+}
+
+/* apl_text.__index: t[i] is item i as a string, other keys give nil */
+static int text_index(lua_State *L) {
+  apl_text *T=text_check(L,1);
+  int i;
+  if (lua_type(L,2)!=LUA_TNUMBER) return 0;
+  i=lua_tointeger(L,2);
+  if (i<1 || i>T->len || i!=lua_tonumber(L,2)) return 0;
+  lua_pushlstring(L,text_at(T,i-1),text_size(T,i-1));
+  return 1;
+}
+
+/* apl_text.__tostring */
+static int text_tostring(lua_State *L) {
+  apl_text *T=text_check(L,1);
+  lua_pushlstring(L,text_at(T,0),T->off[T->len]-T->off[0]);
+  return 1;
+}
+
+/* apl_text.__eq */
+static int text_same(lua_State *L) {
+  apl_text *T=text_check(L,1), *V=text_check(L,2);
+  size_t l=T->off[T->len]-T->off[0];
+  lua_pushboolean(L,T->len==V->len && l==(size_t)(V->off[V->len]-V->off[0])
+    && !memcmp(text_at(T,0),text_at(V,0),l));
+  return 1;
+}
+
+/* The items of the argument at idx: a text, a string (one item) or an 
+   APL vector. Returns the number of items, or -1 for anything else. */
+static int text_items(lua_State *L, int idx, apl_text **T) {
+  int dims[APL_MAXRANK];
+  *T=text_test(L,idx);
+  if (*T) return (*T)->len;
+  if (lua_type(L,idx)==LUA_TSTRING) return 1;
+  if (!lua_istable(L,idx) || nd_dims(L,idx,dims)>1) return -1;
+  return aplL_len(L,idx);
+}
+
+/* Item i (0-based) of the argument at idx as seen by text_items, in *s 
+   and *l. Returns 0 if that item is not a string. */
+static int text_item(lua_State *L, int idx, apl_text *T, int i, 
+    const char **s, size_t *l) {
+  if (T) { *s=text_at(T,i); *l=text_size(T,i); return 1; }
+  if (lua_type(L,idx)==LUA_TSTRING) { *s=lua_tolstring(L,idx,l); return 1; }
+  lua_rawgeti(L,idx,i+1);
+  *s=lua_tolstring(L,-1,l);    /* the table keeps the string alive */
+  i=lua_type(L,-1)==LUA_TSTRING;
+  lua_pop(L,1);
+  return i;
+}
+
+/* texteq(w,a[,ne]): a=w, or a≠w if ne is true, item by item, where one
+   of w and a is a text and the other a text, a string or a vector. 
+   Returns nothing for other arguments, which the caller must handle. */
+static int text_eq(lua_State *L) {
+  apl_text *W, *A;
+  int nw=text_items(L,1,&W), na=text_items(L,2,&A), ne=lua_toboolean(L,3);
+  int i, n=nw==0 || na==0 ? 0 : nw>na ? nw : na;
+  const char *sw, *sa;
+  size_t lw, la;
+  if (!(W || A) || nw<0 || na<0) return 0;
+  luaL_argcheck(L,nw==na || nw==1 || na==1,2,"size mismatch");
+  lua_settop(L,2);
+  core_new(L,n,0);
+  for (i=0; i<n; i++) {
+    int eq=text_item(L,1,W,nw==1 ? 0 : i,&sw,&lw) && 
+      text_item(L,2,A,na==1 ? 0 : i,&sa,&la) && lw==la && !memcmp(sw,sa,lw);
+    lua_pushinteger(L,eq!=ne);
+    lua_rawseti(L,3,i+1);
+  }
+  return 1;
+}
+
+/* A number that identifies a codepoint by its bytes. Only lead bytes of 
+   longer codepoints start with 0xC0 or more, so no two codepoints give 
+   the same number. */
+static lua_Number text_key(const char *s, size_t l) {
+  lua_Number k=0;
+  while (l--) k=256*k+*(const unsigned char *)s++;
+  return k;
+}
+
+/* textfind(t,x[,has]): t⍳x for the text t and a text, string or vector 
+   x, or x∊t if `has` is true. Single bytes are looked up in an array, 
+   longer codepoints in a table. Returns nothing for other x. */
+static int text_find(lua_State *L) {
+  apl_text *T=text_check(L,1), *X;
+  int n=text_items(L,2,&X), has=lua_toboolean(L,3), i, k, m=T->len;
+  int byte[256];
+  const char *s;
+  size_t l;
+  if (n<0) return 0;
+  lua_settop(L,2);
+  lua_newtable(L);          /* 3: first position of longer codepoints */
+  memset(byte,0,sizeof(byte));
+  for (i=m-1; i>=0; i--) {
+    s=text_at(T,i); l=text_size(T,i);
+    if (l==1) byte[*(const unsigned char *)s]=i+1;
+    else {
+      lua_pushnumber(L,text_key(s,l)); lua_pushinteger(L,i+1);
+      lua_rawset(L,3);
+    }
+  }
+  if (lua_type(L,2)!=LUA_TSTRING) core_new(L,n,0);   /* 4: result */
+  for (i=0; i<n; i++) {
+    k=0;
+    if (text_item(L,2,X,i,&s,&l) && l>0 && 
+        utf_step((const unsigned char *)s,(const unsigned char *)s+l)==l) {
+      if (l==1) k=byte[*(const unsigned char *)s];
+      else {
+        lua_pushnumber(L,text_key(s,l)); lua_rawget(L,3);
+        k=lua_tointeger(L,-1);
+        lua_pop(L,1);
+      }
+    }
+    if (has) lua_pushinteger(L,k>0);
+    else lua_pushinteger(L,k>0 ? k : m+1);
+    if (lua_gettop(L)==5) lua_rawseti(L,4,i+1);
+  }
+  return 1;
+}
+
+static const luaL_Reg text_meta[] = {
+  {"__len", text_len},
+  {"__index", text_index},
+  {"__tostring", text_tostring},
+  {"__eq", text_same},
+  {NULL, NULL}
+};
+
 /* check compatibility of shapes */
 static int check_compat(lua_State *L, int a1, int a2, int *m, int *n) {
   int l1=-1,m1=-2,n1=-3, l2=-4,m2=-5,n2=-6,k=1,l=1;
   if (!lua_istable(L,a1) || !lua_istable(L,a2)) return 1;    /* scalar */    
+  if (!nd_match(L,a1,a2,&k,&l)) {
+    if (m&&n) { *m=k; *n=l; }
+    return 0;
+  }
   apl_getshapeinfo(a1,l1,m1,n1);
   apl_getshapeinfo(a2,l2,m2,n2);
   if (l1>=0 && l2>=0) { k=l1; l=l2; }  /* two vectors */
@@ -401,9 +1034,39 @@ static int apl_compat(lua_State *L) {
   return 3;
 }
 
-/* each(f,a): applies f termwise to every item in a */
+/* each(f,a): applies f termwise to every item in a. The loop keeps
+   n at index 4 and its position in the continuation context: 2i while 
+   f(a[i]) runs, 2i+1 while progress is reported before item i. */
+static int each_from(lua_State *L, int i, int polled);
+
+static int each_k(lua_State *L) {
+  int ctx=0;
+  lua_getctx(L,&ctx);
+  if (ctx&1) { lua_settop(L,4); return each_from(L,ctx>>1,1); }
+  lua_rawseti(L,3,ctx>>1);
+  return each_from(L,(ctx>>1)+1,0);
+}
+
+static int each_from(lua_State *L, int i, int polled) {
+  int n=lua_tointeger(L,4);
+  for (; i<=n; i++, polled=0) {
+    if (!polled && i>1 && (i-1)%APL_SLICE==0) 
+      apl_slice(L,i-1,n,2*i+1,each_k);
+    lua_pushvalue(L,1);
+    lua_rawgeti(L,2,i);
+    if (lua_isnoneornil(L,-1)) { 
+      lua_rawseti(L,3,i); lua_settop(L,4); continue; 
+    }    
+    lua_callk(L,1,1,2*i,each_k);
+    lua_rawseti(L,3,i);
+  }
+  apl_cloneshape(L,1,2,3); 
+  lua_settop(L,3);
+  return 1;
+}
+
 static int apl_each(lua_State *L) {
-  int i, n, tbl=lua_istable(L,2);
+  int n, tbl=lua_istable(L,2);
   luaL_checktype(L,1,LUA_TFUNCTION);
   luaL_argcheck(L,!lua_isnoneornil(L,2),2,"nil not allowed");
   lua_settop(L,2);
@@ -413,17 +1076,8 @@ static int apl_each(lua_State *L) {
   }  
   n=luaL_len(L,2);
   core_new(L,n,0);
-  for (i=1; i<=n; i++) {
-    lua_pushvalue(L,1);
-    lua_rawgeti(L,2,i);
-    if (lua_isnoneornil(L,-1)) { 
-      lua_rawseti(L,3,i); lua_settop(L,3); continue; 
-    }    
-    lua_call(L,1,1);
-    lua_rawseti(L,3,i);
-  }
-  apl_cloneshape(L,1,2,3); 
-  return 1;
+  lua_pushinteger(L,n);
+  return each_from(L,1,0);
 }
 
 #define f 1
@@ -444,9 +1098,50 @@ static int apl_each(lua_State *L) {
  * If either equals 2, the corresponding argument is used every time even
    if it is a table.
  */
+#define n_at 5
+#define use_at 6
+#define USE1 1          /* index a1 */
+#define USE2 2          /* index a2 */
+#define SHAPE1 4        /* copy the shape of a1 */
+#define SHAPE2 8        /* copy the shape of a2 */
+/* the loop keeps n and the flags above at n_at and use_at, and its 
+   position in the continuation context as in `each` */
+static int both_from(lua_State *L, int i, int polled);
+
+static int both_k(lua_State *L) {
+  int ctx=0;
+  lua_getctx(L,&ctx);
+  if (ctx&1) { lua_settop(L,use_at); return both_from(L,ctx>>1,1); }
+  lua_rawseti(L,r,ctx>>1);
+  return both_from(L,(ctx>>1)+1,0);
+}
+
+static int both_from(lua_State *L, int i, int polled) {
+  int n=lua_tointeger(L,n_at), use=lua_tointeger(L,use_at);
+  for (; i<=n; i++, polled=0) {
+    if (!polled && i>1 && (i-1)%APL_SLICE==0) 
+      apl_slice(L,i-1,n,2*i+1,both_k);
+    lua_pushvalue(L,f);
+    if (use&USE1) lua_rawgeti(L,a1,i); else lua_pushvalue(L,a1);
+    if (lua_isnoneornil(L,-1)) { 
+      lua_rawseti(L,r,i); lua_settop(L,use_at); continue; 
+    }    
+    if (use&USE2) lua_rawgeti(L,a2,i); else lua_pushvalue(L,a2);
+    if (lua_isnoneornil(L,-1)) { 
+      lua_rawseti(L,r,i); lua_settop(L,use_at); continue; 
+    } 
+    lua_callk(L,2,1,2*i,both_k);
+    lua_rawseti(L,r,i);
+  }
+  apl_cloneshape(L,use&SHAPE2,a2,r);  /* rows and cols from a2 */
+  apl_cloneshape(L,use&SHAPE1,a1,r);  /* a1 overrides a2 */
+  lua_settop(L,r);
+  return 1;
+}
+
 static int apl_both(lua_State *L) {
   int both1=lua_tointeger(L,x1), both2=lua_tointeger(L,x2), 
-    i, n, n1=1, n2=1, s=0, tbl1=lua_istable(L,a1), tbl2=lua_istable(L,a2); 
+    n, n1=1, n2=1, s=0, tbl1=lua_istable(L,a1), tbl2=lua_istable(L,a2); 
   luaL_checktype(L,f,LUA_TFUNCTION);
   luaL_argcheck(L,!lua_isnoneornil(L,a1),a1,"nil not allowed");
   luaL_argcheck(L,!lua_isnoneornil(L,a2),a2,"nil not allowed");
@@ -471,23 +1166,18 @@ static int apl_both(lua_State *L) {
   if (s && lua_istable(L,s)) { /* replace singleton table by its one item */
     lua_rawgeti(L,s,1); lua_replace(L,s); 
   }
-  for (i=1; i<=n; i++) {
-    lua_pushvalue(L,f);
-    if (tbl1 && both1!=2) lua_rawgeti(L,a1,i); else lua_pushvalue(L,a1);
-    if (lua_isnoneornil(L,-1)) { 
-      lua_rawseti(L,r,i); lua_settop(L,r); continue; 
-    }    
-    if (tbl2 && both2!=2) lua_rawgeti(L,a2,i); else lua_pushvalue(L,a2);
-    if (lua_isnoneornil(L,-1)) { 
-      lua_rawseti(L,r,i); lua_settop(L,r); continue; 
-    } 
-    lua_call(L,2,1);
-    lua_rawseti(L,r,i);
-  }
-  apl_cloneshape(L,tbl2,a2,r);  /* rows and cols from a2 */
-  apl_cloneshape(L,tbl1,a1,r);  /* a1 overrides a2 */
-  return 1;
+  lua_pushinteger(L,n);
+  lua_pushinteger(L,(tbl1 && both1!=2 ? USE1 : 0) | 
+    (tbl2 && both2!=2 ? USE2 : 0) | (tbl1 ? SHAPE1 : 0) | 
+    (tbl2 ? SHAPE2 : 0));
+  return both_from(L,1,0);
 }
+#undef n_at
+#undef use_at
+#undef USE1
+#undef USE2
+#undef SHAPE1
+#undef SHAPE2
 #undef f
 #undef r
 #undef a1
@@ -495,48 +1185,1869 @@ static int apl_both(lua_State *L) {
 #undef x1
 #undef x2
   
+/* Tolerant comparisons. testeq(w,a,act,rct), testge and testle give 
+   the APL results of a=w, a≥w and a≤w: numbers count as equal when 
+   |w-a|<act or |w-a|<rct*|w|. Missing tolerances count as 0, in which 
+   case the comparisons are exact. Arrays are treated as by `both` with 
+   x1=x2=1. Non-numbers are compared by Lua's == and <. */
+#define CMP_EQ 0
+#define CMP_GE 1
+#define CMP_LE 2
+static int cmp_num(int op, lua_Number w, lua_Number a, 
+   lua_Number act, lua_Number rct) {
+  lua_Number d;
+  if (op==CMP_GE && a>w) return 1;
+  if (op==CMP_LE && a<w) return 1;
+  if (a==w) return 1;
+  d=fabs(w-a);
+  return d<act || d<rct*fabs(w);
+}
+
+static int cmp_item(lua_State *L, int op, int w, int a, 
+   lua_Number act, lua_Number rct) {
+  if (lua_type(L,w)==LUA_TNUMBER && lua_type(L,a)==LUA_TNUMBER)
+    return cmp_num(op,lua_tonumber(L,w),lua_tonumber(L,a),act,rct);
+  if (op==CMP_GE && lua_compare(L,w,a,LUA_OPLT)) return 1;
+  if (op==CMP_LE && lua_compare(L,a,w,LUA_OPLT)) return 1;
+  return lua_compare(L,a,w,LUA_OPEQ);
+}
+
+#define w 1
+#define a 2
+#define r 5
+static int cmp_tolerant(lua_State *L, int op) {
+  lua_Number act=luaL_optnumber(L,3,0), rct=luaL_optnumber(L,4,0), x, y;
+  int i, n, nw=1, na=1, tw=lua_istable(L,w), ta=lua_istable(L,a), 
+    exact=act<=0 && rct<=0;
+  luaL_argcheck(L,!lua_isnoneornil(L,w),w,"nil not allowed");
+  luaL_argcheck(L,!lua_isnoneornil(L,a),a,"nil not allowed");
+  lua_settop(L,r-1);
+  if (!tw && !ta) {
+    lua_pushinteger(L,cmp_item(L,op,w,a,act,rct));
+    return 1;
+  }
+  if (tw) nw=luaL_len(L,w); 
+  if (ta) na=luaL_len(L,a);
+  n = nw>na?nw:na;
+  core_new(L,n,0);
+  if (!(nw&&na)) return 1;  
+  if (tw && na==1) { 
+    if (ta) { lua_rawgeti(L,a,1); lua_replace(L,a); ta=0; }
+  }
+  else if (ta && nw==1) { 
+    if (tw) { lua_rawgeti(L,w,1); lua_replace(L,w); tw=0; }
+  }
+  else luaL_argcheck(L,check_compat(L,w,a,NULL,NULL),a,
+      "shapes are incompatible");
+  for (i=1; i<=n; i++) {
+    if (tw) lua_rawgeti(L,w,i); else lua_pushvalue(L,w);
+    if (ta) lua_rawgeti(L,a,i); else lua_pushvalue(L,a);
+    if (lua_isnil(L,-1) || lua_isnil(L,-2)) { 
+      lua_pop(L,2); lua_pushnil(L); lua_rawseti(L,r,i); continue; 
+    }
+    if (exact && lua_type(L,-1)==LUA_TNUMBER && 
+        lua_type(L,-2)==LUA_TNUMBER) { 
+      x=lua_tonumber(L,-2); y=lua_tonumber(L,-1);
+      lua_pop(L,2);
+      lua_pushinteger(L, op==CMP_EQ ? y==x : op==CMP_GE ? y>=x : y<=x);
+    }
+    else {
+      x=cmp_item(L,op,r+1,r+2,act,rct);
+      lua_pop(L,2);
+      lua_pushinteger(L,(int)x);
+    }
+    lua_rawseti(L,r,i);
+  }
+  apl_cloneshape(L,ta,a,r);  
+  apl_cloneshape(L,tw,w,r);  /* w overrides a, as in `both` */
+  return 1;
+}
+#undef w
+#undef a
+#undef r
+
+static int apl_testeq(lua_State *L) { return cmp_tolerant(L,CMP_EQ); }
+static int apl_testge(lua_State *L) { return cmp_tolerant(L,CMP_GE); }
+static int apl_testle(lua_State *L) { return cmp_tolerant(L,CMP_LE); }
+  
 void apl_array(lua_State *L,double *s,int l) {
   int i, t;
-  core_new(L,l,0);
+  lua_createtable(L,l,3);
   t=lua_gettop(L);
   for (i=0; i<l; i++) { lua_pushnumber(L,s[i]); lua_rawseti(L,t,i+1); }
+  lua_pushinteger(L,l);
+  lua_setfield(L,t,"apl_len");
+  apl_setmetatable(L,t);
 }
 
-void dgesvd_(char *jobu, char *jobvt, int *m, int *n, double *a, int* lda,
-  double *s,  double *u, int *ldu,  double *vt, int *ldvt, 
-  double *work, int *lwork, int *info);
+/* Mixed-radix conversion, with Lua's % for the digits so that the
+   results agree with Decode and Encode in apl.lua */
 
-/* svd(a) returns u,s,v; u and v as nested arrays */
-static int apl_svd(lua_State *L) {
-  int i,j,k,l,m,n,info,lw;
-  double *a, *u, *s, *vt, w0;
-  luaL_argcheck(L,lua_gettop(L)<2,2,"too many arguments");
-  luaL_checktype(L,1,LUA_TTABLE);
-  apl_getshapeinfo(1,l,m,n);
-  luaL_argcheck(L, m>0 && n>0, 1, "nonempty APL matrix required");
-  l = m<n? m :n;
-  a = (double *)(malloc(m*n*sizeof(double)));
-  u = (double *)(malloc(n*l*sizeof(double)));
-  s = (double *)(malloc(l*sizeof(double)));
-  vt = (double *)(malloc(l*m*sizeof(double)));
-  for (i=1; i<=m*n; i++) {
-    lua_rawgeti(L,1,i); a[i-1]=lua_tonumber(L,-1); lua_pop(L,1);
+static lua_Number radix_mod(lua_Number a, lua_Number b) { 
+  return a-floor(a/b)*b; 
+}
+
+/* number of items of the numeric vector or matrix at `idx`, 0 for a 
+   number, or -1 for anything else, including an empty array; sets rows
+   and cols for a matrix */
+static int radix_numbers(lua_State *L, int idx, int *rows, int *cols) {
+  int i, l;
+  *rows=-1; *cols=-1;
+  if (lua_type(L,idx)==LUA_TNUMBER) return 0;
+  if (!lua_istable(L,idx)) return -1;
+  apl_getshapeinfo(idx,l,*rows,*cols);
+  if (l==0) return -1;
+  for (i=1; i<=l; i++) {
+    lua_rawgeti(L,idx,i);
+    if (lua_type(L,-1)!=LUA_TNUMBER) { lua_pop(L,1); return -1; }
+    lua_pop(L,1);
   }
-  lw=-1;
-  dgesvd_("S","S",&n,&m,a,&n,s,u,&n,vt,&l,&w0,&lw,&info);
-  if (info==0) lw=(int)w0;
-  if (info==0) {
-    double *w=(double *)malloc(lw*sizeof(double));
-    dgesvd_("S","S",&n,&m,a,&n,s,u,&n,vt,&l,w,&lw,&info);
-    free(w);
-    if (info!=0) { lua_pushinteger(L,info); return 1; }
+  return l;
+}
+
+/* radix digit i (0-based) of a scalar or vector radix */
+#define radix_digit(L,i) (nr ? (lua_rawgeti(L,2,(i)+1), \
+  lua_tonumber(L,-1)) : lua_tonumber(L,2))
+
+/* decode(w,a): ⍺⊤⍵ for a numeric array ⍵ of any rank and a scalar or 
+   vector radix ⍺. A vector radix of m digits adds a leading axis of 
+   length m: an m-vector for scalar ⍵, an m×n matrix, one column per 
+   value, for an n-vector ⍵, and so on. A scalar radix gives ⍵ modulo ⍺.
+   Returns nothing in other cases. */
+static int apl_decode(lua_State *L) {
+  int i, j, m, n, nr, rows, cols, res, dims[APL_MAXRANK+1];
+  lua_Number v, d, r;
+  lua_settop(L,2);
+  nr=radix_numbers(L,2,&rows,&cols);
+  if (nr<0 || rows>=0) return 0;
+  n=radix_numbers(L,1,&rows,&cols);
+  if (n<0) return 0;
+  m = nr ? nr : 1;
+  core_new(L,m*(n?n:1),0);
+  res=lua_gettop(L);
+  for (j=0; j<(n?n:1); j++) {
+    if (n) { lua_rawgeti(L,1,j+1); v=lua_tonumber(L,-1); lua_pop(L,1); }
+    else v=lua_tonumber(L,1);
+    for (i=m-1; i>=0; i--) {
+      r=radix_digit(L,i);
+      if (nr) lua_pop(L,1);
+      d=radix_mod(v,r);
+      v=(v-d)/r;
+      lua_pushnumber(L,d);
+      lua_rawseti(L,res,i*(n?n:1)+j+1);
+    }
   }
-  else { luaL_error(L,"error on first call to dgesvd, info=%d\n",info); }
-  apl_array(L,u,l*n); 
-  apl_array(L,s,l);
-  apl_array(L,vt,l*m);
-  free(vt); free(s); free(u); free(a);
-  return 3;
+  if (!nr && !n) lua_rawgeti(L,res,1);  /* scalar */
+  else if (n) {
+    dims[0]=m;
+    nd_setshape(L,res,(nr>0)+nd_dims(L,1,dims+(nr>0)),dims);
+  }
+  return 1;
+}
+
+/* encode(w,a): ⍺⊥⍵ for a numeric array ⍵ of digits and a scalar or 
+   vector radix ⍺, the digits of each number running along the first 
+   axis, which the result drops. A vector radix must have one element 
+   per digit. Returns nothing in other cases. */
+static int apl_encode(lua_State *L) {
+  int i, j, m, n, l, nr, rows, cols, res=0, rank, dims[APL_MAXRANK];
+  lua_Number v, r;
+  lua_settop(L,2);
+  nr=radix_numbers(L,2,&rows,&cols);
+  if (nr<0 || rows>=0) return 0;
+  l=radix_numbers(L,1,&rows,&cols);
+  if (l<=0) return 0;
+  rank=nd_dims(L,1,dims);
+  m=dims[0]; n=l/m;
+  if (nr && nr!=m) return 0;
+  if (rank>1) { core_new(L,n,0); res=lua_gettop(L); }
+  for (j=0; j<n; j++) {
+    v=0;
+    for (i=0; i<m; i++) {
+      r=radix_digit(L,i);
+      if (nr) lua_pop(L,1);
+      lua_rawgeti(L,1,i*n+j+1);
+      v=r*v+lua_tonumber(L,-1);
+      lua_pop(L,1);
+    }
+    if (rank==1) { lua_pushnumber(L,v); return 1; }
+    lua_pushnumber(L,v);
+    lua_rawseti(L,res,j+1);
+  }
+  nd_setshape(L,res,rank-1,dims+1);
+  return 1;
+}
+#undef radix_digit
+
+/* ------------------ Random number package ----------------------- */
+
+/* xoshiro256** by D. Blackman and S. Vigna, seeded through splitmix64. 
+   Stream k of a seed is the seeded state advanced by k jumps of 2^128 
+   steps, so that streams of the same seed never overlap. The default 
+   generator lives in the registry as "apl_rng". */
+
+typedef unsigned long long rng_word;
+typedef struct { rng_word s[4]; } apl_rng;
+
+static rng_word rng_rotl(rng_word x, int k) { return (x<<k) | (x>>(64-k)); }
+
+static rng_word rng_next(apl_rng *g) {
+  rng_word *s=g->s, res=rng_rotl(s[1]*5,7)*9, t=s[1]<<17;
+  s[2]^=s[0]; s[3]^=s[1]; s[1]^=s[2]; s[0]^=s[3];
+  s[2]^=t; s[3]=rng_rotl(s[3],45);
+  return res;
+}
+
+static void rng_jump(apl_rng *g) {
+  static const rng_word jump[] = { 0x180ec6d33cfd0abaULL, 
+    0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+  rng_word t[4]={0,0,0,0};
+  int i, b, j;
+  for (i=0; i<4; i++) for (b=0; b<64; b++) {
+    if (jump[i] & (1ULL<<b)) for (j=0; j<4; j++) t[j]^=g->s[j];
+    rng_next(g);
+  }
+  for (j=0; j<4; j++) g->s[j]=t[j];
+}
+
+static void rng_seed(apl_rng *g, rng_word seed, int stream) {
+  int i;
+  for (i=0; i<4; i++) {   /* splitmix64 */
+    rng_word z=(seed+=0x9e3779b97f4a7c15ULL);
+    z=(z^(z>>30))*0xbf58476d1ce4e5b9ULL;
+    z=(z^(z>>27))*0x94d049bb133111ebULL;
+    g->s[i]=z^(z>>31);
+  }
+  while (stream-->0) rng_jump(g);
+}
+
+/* uniform integer in [0,n), without modulo bias */
+static rng_word rng_below(apl_rng *g, rng_word n) {
+  rng_word x, limit=-n%n;
+  do x=rng_next(g); while (x<limit);
+  return x%n;
+}
+
+static apl_rng *rng_default(lua_State *L) {
+  apl_rng *g;
+  lua_getfield(L,LUA_REGISTRYINDEX,"apl_rng");
+  g=(apl_rng *)lua_touserdata(L,-1);
+  lua_pop(L,1);
+  return g;
+}
+
+/* seed(seed[,stream]): restarts the default generator */
+static int rng_setseed(lua_State *L) {
+  lua_Number seed=luaL_checknumber(L,1);
+  int stream=luaL_optint(L,2,0);
+  luaL_argcheck(L,stream>=0,2,"must be a non-negative integer");
+  rng_seed(rng_default(L),(rng_word)(long long)seed,stream);
+  return 0;
+}
+
+/* one roll: integer in [1,n], or a number in [0,1) if n is 0 */
+static lua_Number rng_roll(lua_State *L, apl_rng *g, int idx) {
+  lua_Number n;
+  luaL_argcheck(L,lua_type(L,idx)==LUA_TNUMBER,1,"numbers expected");
+  n=lua_tonumber(L,idx);
+  if (n==0) return (rng_next(g)>>11)*(1.0/9007199254740992.0);
+  luaL_argcheck(L,n>=1 && n<=9007199254740992.0 && n==floor(n),1,
+     "positive integers expected");
+  return (lua_Number)(rng_below(g,(rng_word)n)+1);
+}
+
+/* roll(a): a random integer from 1 to `n` for every item `n` of `a`,
+   in a fresh array of the same shape */
+static int apl_roll(lua_State *L) {
+  apl_rng *g=rng_default(L);
+  int i, n;
+  if (!lua_istable(L,1)) {
+    lua_pushnumber(L,rng_roll(L,g,1));
+    return 1;
+  }
+  lua_settop(L,1);
+  n=luaL_len(L,1);
+  core_new(L,n,0);
+  for (i=1; i<=n; i++) {
+    lua_rawgeti(L,1,i);
+    lua_pushnumber(L,rng_roll(L,g,3));
+    lua_rawseti(L,2,i);
+    lua_pop(L,1);
+  }
+  apl_cloneshape(L,1,1,2);
+  return 1;
+}
+
+/* deal(a,n): `a` distinct random integers from 1 to `n`. A partial 
+   Fisher-Yates shuffle of 1..n in which only the displaced items are 
+   stored, in an open-addressing hash table, so that space is O(a). */
+typedef struct { rng_word key, val; } rng_slot;
+
+static rng_slot *deal_slot(rng_slot *h, rng_word mask, rng_word key) {
+  rng_word i=(key*0x9e3779b97f4a7c15ULL)>>20 & mask;
+  while (h[i].key && h[i].key!=key+1) i=(i+1)&mask;
+  return h+i;
+}
+
+static int apl_deal(lua_State *L) {
+  lua_Number a=luaL_checknumber(L,1), n=luaL_checknumber(L,2);
+  apl_rng *g=rng_default(L);
+  rng_word k, j, mask=1, vj;
+  rng_slot *h, *sj, *sk;
+  luaL_argcheck(L,a>=0 && a==floor(a),1,"must be a non-negative integer");
+  luaL_argcheck(L,n>=0 && n==floor(n) && n<=9007199254740992.0,2,
+     "must be a non-negative integer");
+  luaL_argcheck(L,a<=n,1,"can't deal more items than there are");
+  while (mask<2*a) mask<<=1;
+  h=(rng_slot *)lua_newuserdata(L,mask*sizeof(rng_slot));
+  memset(h,0,mask*sizeof(rng_slot));
+  mask--;
+  core_new(L,(int)a,0);
+  for (k=0; k<a; k++) {
+    j=k+rng_below(g,(rng_word)n-k);
+    sj=deal_slot(h,mask,j);
+    vj = sj->key ? sj->val : j;
+    sk=deal_slot(h,mask,k);
+    sj->val = sk->key ? sk->val : k;
+    sj->key = j+1;  /* 0 marks an empty slot */
+    lua_pushnumber(L,(lua_Number)(vj+1));
+    lua_rawseti(L,-2,(int)k+1);
+  }
+  return 1;
+}
+
+/* ------------------ Parallel numeric package ----------------------- */
+
+/* Elementwise, reduce, outer and gather kernels for numeric arrays. The
+   Lua tables are copied to C buffers and back on the calling thread;
+   only the arithmetic in between is shared out. Work is cut into 
+   chunks of fixed size PAR_CHUNK, which threads claim one at a time, so
+   the chunks and the order in which partial reductions are combined 
+   do not depend on the number of threads. Arrays shorter than the 
+   threshold are done on the calling thread only. The pool belongs to
+   the process, not to a lua_State: `busy` lets only one state at a time
+   hand it a job or change the number of threads.
+   Compile with -DAPL_NO_THREADS where pthreads are not available. */
+
+#define PAR_CHUNK 65536
+
+typedef void (*par_kernel)(void *job, long lo, long hi, int chunk);
+
+static struct {
+  int nthreads;       /* including the calling thread */
+  long threshold;  
+  int nworkers;       /* worker threads actually running */
+#ifndef APL_NO_THREADS
+  pthread_t *worker;
+  pthread_mutex_t busy; /* held by the state using the workers */
+  pthread_mutex_t lock;
+  pthread_cond_t work, done;
+  int quit;
+  unsigned long generation;
+  par_kernel kernel;  /* current job, protected by lock */
+  void *job;
+  long n;
+  int nchunks, next, finished;
+#endif
+} pool = { 0, 1<<18, 0 
+#ifndef APL_NO_THREADS
+  , NULL, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, 
+  PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, NULL, NULL,
+  0, 0, 0, 0
+#endif
+};
+
+static int par_nchunks(long n) { return (int)((n+PAR_CHUNK-1)/PAR_CHUNK); }
+
+#ifndef APL_NO_THREADS
+/* claim and run chunks until none are left; call with lock held */
+static void par_claim(void) {
+  while (pool.next<pool.nchunks) {
+    int c;
+    if (apl_interrupted) { pool.nchunks=pool.next; break; }
+    c=pool.next++;
+    long lo=(long)c*PAR_CHUNK, hi=lo+PAR_CHUNK;
+    par_kernel kernel=pool.kernel;
+    void *job=pool.job;
+    if (hi>pool.n) hi=pool.n;
+    pthread_mutex_unlock(&pool.lock);
+    kernel(job,lo,hi,c);
+    pthread_mutex_lock(&pool.lock);
+    if (++pool.finished==pool.nchunks) pthread_cond_signal(&pool.done);
+  }
+}
+
+static void *par_worker(void *arg) {
+  unsigned long seen=0;
+  (void)arg;
+  pthread_mutex_lock(&pool.lock);
+  for (;;) {
+    while (!pool.quit && pool.generation==seen) 
+      pthread_cond_wait(&pool.work,&pool.lock);
+    if (pool.quit) break;
+    seen=pool.generation;
+    par_claim();
+  }
+  pthread_mutex_unlock(&pool.lock);
+  return NULL;
+}
+
+static void par_stop(void) {
+  int i;
+  if (!pool.nworkers) return;
+  pthread_mutex_lock(&pool.lock);
+  pool.quit=1;
+  pthread_cond_broadcast(&pool.work);
+  pthread_mutex_unlock(&pool.lock);
+  for (i=0; i<pool.nworkers; i++) pthread_join(pool.worker[i],NULL);
+  free(pool.worker);
+  pool.worker=NULL; pool.nworkers=0; pool.quit=0;
+}
+
+/* start the workers; if that fails, carry on with those we have */
+static void par_start(void) {
+  int want=pool.nthreads-1;
+  pool.worker=(pthread_t *)malloc(want*sizeof(pthread_t));
+  if (!pool.worker) return;
+  while (pool.nworkers<want && pthread_create(pool.worker+pool.nworkers,
+     NULL,par_worker,NULL)==0) pool.nworkers++;
+}
+#endif
+
+/* run kernel over 0..n-1 in chunks */
+static void par_run(lua_State *L, par_kernel kernel, void *job, long n) {
+  int c, nchunks=par_nchunks(n);
+#ifndef APL_NO_THREADS
+  if (pool.nthreads>1 && nchunks>1 && n>=pool.threshold) {
+    pthread_mutex_lock(&pool.busy);
+    if (pool.nthreads>1 && !pool.nworkers) par_start();
+    if (pool.nworkers) {
+      pthread_mutex_lock(&pool.lock);
+      pool.kernel=kernel; pool.job=job; pool.n=n; 
+      pool.nchunks=nchunks; pool.next=0; pool.finished=0;
+      pool.generation++;
+      pthread_cond_broadcast(&pool.work);
+      par_claim();
+      while (pool.finished<pool.nchunks) 
+        pthread_cond_wait(&pool.done,&pool.lock);
+      pthread_mutex_unlock(&pool.lock);
+      pthread_mutex_unlock(&pool.busy);
+      apl_checkinterrupt(L);
+      return;
+    }
+    pthread_mutex_unlock(&pool.busy);
+  }
+#endif
+  for (c=0; c<nchunks; c++) {
+    long lo=(long)c*PAR_CHUNK, hi=lo+PAR_CHUNK;
+    if (c>0) apl_checkinterrupt(L);
+    kernel(job,lo,hi<n?hi:n,c);
+  }
+}
+
+/* threads([n[,threshold]]): sets the number of threads and the array 
+   length below which only one is used; returns both settings */
+static int par_threads(lua_State *L) {
+  int n=luaL_optint(L,1,pool.nthreads);
+  long threshold=(long)luaL_optnumber(L,2,(lua_Number)pool.threshold);
+  luaL_argcheck(L,n>=1,1,"must be a positive integer");
+  luaL_argcheck(L,threshold>=0,2,"must be a non-negative integer");
+#ifdef APL_NO_THREADS
+  n=1;
+#else
+  pthread_mutex_lock(&pool.busy);
+  if (n!=pool.nthreads) par_stop();
+#endif
+  pool.nthreads=n;
+  pool.threshold=threshold;
+#ifndef APL_NO_THREADS
+  pthread_mutex_unlock(&pool.busy);
+#endif
+  lua_pushinteger(L,pool.nthreads);
+  lua_pushinteger(L,pool.threshold);
+  return 2;
+}
+
+static int par_gc(lua_State *L) {
+  (void)L;
+#ifndef APL_NO_THREADS
+  pthread_mutex_lock(&pool.busy);
+  par_stop();
+  pthread_mutex_unlock(&pool.busy);
+#endif
+  return 0;
+}
+
+static void par_init(lua_State *L) {
+#ifndef APL_NO_THREADS
+  pthread_mutex_lock(&pool.busy);
+#endif
+  if (!pool.nthreads) {
+    int n=1;
+#if !defined(APL_NO_THREADS) && defined(_SC_NPROCESSORS_ONLN)
+    n=(int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (n<1) n=1;
+#endif
+    pool.nthreads=n;
+  }
+#ifndef APL_NO_THREADS
+  pthread_mutex_unlock(&pool.busy);
+#endif
+  /* the workers must be stopped before the library is unloaded */
+  lua_newuserdata(L,1);
+  lua_createtable(L,0,1);
+  lua_pushcfunction(L,par_gc);
+  lua_setfield(L,-2,"__gc");
+  lua_setmetatable(L,-2);
+  lua_setfield(L,LUA_REGISTRYINDEX,"apl_pool");
+}
+
+/* copies the array at `idx` into a new userdata buffer, or returns NULL 
+   if any of its `n` items is not a number */
+static double *par_numbers(lua_State *L, int idx, int n) {
+  int i;
+  double *x=(double *)lua_newuserdata(L,n*sizeof(double)+1);
+  for (i=0; i<n; i++) {
+    lua_rawgeti(L,idx,i+1);
+    if (lua_type(L,-1)!=LUA_TNUMBER) { lua_pop(L,2); return NULL; }
+    x[i]=lua_tonumber(L,-1);
+    lua_pop(L,1);
+  }
+  return x;
+}
+
+/* the scalar functions, with arguments in the order of apl.lua */
+static const char *const par_op1[] = 
+  {"abs", "ceil", "exp", "floor", "ln", "recip", "unm", NULL};
+static const char *const par_op2[] = 
+  {"add", "sub", "mul", "div", "max", "min", "pow", "mod", NULL};
+enum { OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MAX, OP_MIN, OP_POW, OP_MOD };
+
+static double par_apply1(int op, double w) {
+  switch (op) {
+    case 0: return fabs(w);
+    case 1: return ceil(w);
+    case 2: return exp(w);
+    case 3: return floor(w);
+    case 4: return log(w);
+    case 5: return 1/w;
+    default: return -w;
+  }
+}
+
+static double par_apply2(int op, double w, double a) {
+  switch (op) {
+    case OP_ADD: return a+w;
+    case OP_SUB: return a-w;
+    case OP_MUL: return a*w;
+    case OP_DIV: return a/w;
+    case OP_MAX: return a>w ? a : w;   /* math.max(w,a) */
+    case OP_MIN: return a<w ? a : w;   /* math.min(w,a) */
+    case OP_POW: return pow(a,w);
+    default: return w-floor(w/a)*a;    /* w%a */
+  }
+}
+
+typedef struct {
+  int op;
+  const double *w, *a;
+  long sw, sa;         /* strides: 0 for a broadcast singleton */
+  const int *idx;
+  long n;              /* row length, for `outer` */
+  double *r;
+} par_job;
+
+static void kernel_map1(void *job, long lo, long hi, int chunk) {
+  par_job *J=(par_job *)job;
+  long k;
+  (void)chunk;
+  for (k=lo; k<hi; k++) J->r[k]=par_apply1(J->op,J->w[k]);
+}
+
+#define PAR_LOOP(expr) for (k=lo; k<hi; k++) { \
+  double w=J->w[k*J->sw], a=J->a[k*J->sa]; J->r[k]=(expr); }
+static void kernel_map2(void *job, long lo, long hi, int chunk) {
+  par_job *J=(par_job *)job;
+  long k;
+  (void)chunk;
+  switch (J->op) {  /* the common cases get loops of their own */
+    case OP_ADD: PAR_LOOP(a+w); break;
+    case OP_SUB: PAR_LOOP(a-w); break;
+    case OP_MUL: PAR_LOOP(a*w); break;
+    case OP_DIV: PAR_LOOP(a/w); break;
+    default: PAR_LOOP(par_apply2(J->op,w,a));
+  }
+}
+#undef PAR_LOOP
+
+/* right to left, like Reduce in apl.lua; partial results in r[chunk] */
+static void kernel_reduce(void *job, long lo, long hi, int chunk) {
+  par_job *J=(par_job *)job;
+  double res=J->w[hi-1];
+  long k;
+  for (k=hi-2; k>=lo; k--) res=par_apply2(J->op,res,J->w[k]);
+  J->r[chunk]=res;
+}
+
+static void kernel_outer(void *job, long lo, long hi, int chunk) {
+  par_job *J=(par_job *)job;
+  long k;
+  (void)chunk;
+  for (k=lo; k<hi; k++) 
+    J->r[k]=par_apply2(J->op,J->w[k%J->n],J->a[k/J->n]);
+}
+
+static void kernel_gather(void *job, long lo, long hi, int chunk) {
+  par_job *J=(par_job *)job;
+  long k;
+  (void)chunk;
+  for (k=lo; k<hi; k++) J->r[k]=J->w[J->idx[k]];
+}
+
+/* map1(op,w): op applied to each item of the numeric array w.
+   Returns nothing if w is not a numeric array. */
+static int par_map1(lua_State *L) {
+  par_job J;
+  int n, res;
+  J.op=luaL_checkoption(L,1,NULL,par_op1);
+  if (!lua_istable(L,2)) return 0;
+  lua_settop(L,2);
+  n=luaL_len(L,2);
+  if (!(J.w=par_numbers(L,2,n))) return 0;
+  J.r=(double *)lua_newuserdata(L,n*sizeof(double)+1);
+  par_run(L,kernel_map1,&J,n);
+  apl_array(L,J.r,n);
+  res=lua_gettop(L);
+  apl_cloneshape(L,1,2,res);
+  return 1;
+}
+
+/* map2(op,w,a): op applied termwise to numeric arrays w and a, either 
+   of which may be a scalar or singleton, as in both(f,w,a,1,1).
+   Returns nothing unless the result is a numeric array of compatible 
+   shape, so that the caller can fall back on `both`. */
+static int par_map2(lua_State *L) {
+  par_job J;
+  int n, nw=1, na=1, tw=lua_istable(L,2), ta=lua_istable(L,3), bw, ba, res;
+  double w1, a1;
+  J.op=luaL_checkoption(L,1,NULL,par_op2);
+  lua_settop(L,3);
+  if (!tw && !ta) return 0;
+  if (tw) nw=luaL_len(L,2); 
+  if (ta) na=luaL_len(L,3);
+  if (!(nw&&na)) return 0;
+  n = nw>na?nw:na;
+  bw = nw==1; ba = na==1;   /* broadcast */
+  if (tw && ba) ta=0;
+  else if (ta && bw) tw=0;
+  else if (!check_compat(L,2,3,NULL,NULL)) return 0;
+  J.sw=!bw; J.sa=!ba;
+  if (!bw) { if (!(J.w=par_numbers(L,2,n))) return 0; }
+  else { 
+    if (lua_istable(L,2)) lua_rawgeti(L,2,1); else lua_pushvalue(L,2);
+    if (lua_type(L,-1)!=LUA_TNUMBER) return 0;
+    w1=lua_tonumber(L,-1); J.w=&w1;
+  }
+  if (!ba) { if (!(J.a=par_numbers(L,3,n))) return 0; }
+  else {
+    if (lua_istable(L,3)) lua_rawgeti(L,3,1); else lua_pushvalue(L,3);
+    if (lua_type(L,-1)!=LUA_TNUMBER) return 0;
+    a1=lua_tonumber(L,-1); J.a=&a1;
+  }
+  J.r=(double *)lua_newuserdata(L,n*sizeof(double)+1);
+  par_run(L,kernel_map2,&J,n);
+  apl_array(L,J.r,n);
+  res=lua_gettop(L);
+  apl_cloneshape(L,ta,3,res);  
+  apl_cloneshape(L,tw,2,res);  /* w overrides a, as in `both` */
+  return 1;
+}
+
+/* reduce(op,w): right-to-left reduction of a non-empty numeric vector 
+   by add, mul, max or min, chunk by chunk. Returns nothing if w is not 
+   a numeric array. */
+static int par_reduce(lua_State *L) {
+  par_job J;
+  int n, c, nchunks;
+  double res;
+  J.op=luaL_checkoption(L,1,NULL,par_op2);
+  luaL_argcheck(L,J.op==OP_ADD||J.op==OP_MUL||J.op==OP_MAX||J.op==OP_MIN,
+    1,"only add, mul, max and min are associative");
+  if (!lua_istable(L,2)) return 0;
+  lua_settop(L,2);
+  n=luaL_len(L,2);
+  if (n==0 || !(J.w=par_numbers(L,2,n))) return 0;
+  nchunks=par_nchunks(n);
+  J.r=(double *)lua_newuserdata(L,nchunks*sizeof(double));
+  par_run(L,kernel_reduce,&J,n);
+  res=J.r[nchunks-1];
+  for (c=nchunks-2; c>=0; c--) res=par_apply2(J.op,res,J.r[c]);
+  lua_pushnumber(L,res);
+  return 1;
+}
+
+/* outer(op,w,a): #a×#w matrix with [i][j] = op(w[j],a[i]). Returns 
+   nothing unless w and a are numeric arrays. */
+static int par_outer(lua_State *L) {
+  par_job J;
+  int m, n, res;
+  J.op=luaL_checkoption(L,1,NULL,par_op2);
+  if (!lua_istable(L,2) || !lua_istable(L,3)) return 0;
+  lua_settop(L,3);
+  n=luaL_len(L,2); m=luaL_len(L,3);
+  if (!(J.w=par_numbers(L,2,n)) || !(J.a=par_numbers(L,3,m))) return 0;
+  J.n=n;
+  J.r=(double *)lua_newuserdata(L,(size_t)m*n*sizeof(double)+1);
+  par_run(L,kernel_outer,&J,(long)m*n);
+  apl_array(L,J.r,m*n);
+  res=lua_gettop(L);
+  lua_pushstring(L,"rows"); lua_pushinteger(L,m); lua_rawset(L,res); 
+  lua_pushstring(L,"cols"); lua_pushinteger(L,n); lua_rawset(L,res); 
+  return 1;
+}
+
+/* gather(w,idx): w[idx[k]] for each k, shaped like idx. Returns nothing 
+   unless idx holds valid integer indices of w. */
+static int par_gather(lua_State *L) {
+  par_job J;
+  int i, k, n, len, res, *idx;
+  luaL_checktype(L,1,LUA_TTABLE);
+  if (!lua_istable(L,2)) return 0;
+  lua_settop(L,2);
+  len=luaL_len(L,1); n=luaL_len(L,2);
+  idx=(int *)lua_newuserdata(L,n*sizeof(int)+1);
+  for (k=0; k<n; k++) {
+    lua_rawgeti(L,2,k+1);
+    i=lua_tointeger(L,-1);
+    if (lua_type(L,-1)!=LUA_TNUMBER || i<1 || i>len || 
+       i!=lua_tonumber(L,-1)) return 0;
+    idx[k]=i-1;
+    lua_pop(L,1);
+  }
+  if (n>=pool.threshold && pool.nthreads>1 && (J.w=par_numbers(L,1,len))) {
+    J.idx=idx;
+    J.r=(double *)lua_newuserdata(L,n*sizeof(double)+1);
+    par_run(L,kernel_gather,&J,n);
+    apl_array(L,J.r,n);
+  } else {  /* any values at all */
+    core_new(L,n,0);
+    for (k=0; k<n; k++) { 
+      lua_rawgeti(L,1,idx[k]+1); lua_rawseti(L,-2,k+1); 
+    }
+  }
+  res=lua_gettop(L);
+  apl_cloneshape(L,1,2,res);
+  return 1;
+}
+
+/* ------------------ Sparse matrix package ----------------------- */
+
+/* A sparse matrix is a userdata holding an m×n numeric matrix in 
+   compressed sparse row form: the nonzeros of row i (0-based) are 
+   val[k], in column col[k], for row[i]<=k<row[i+1], with the columns 
+   of each row in increasing order. Sparse matrices are immutable. */
+typedef struct { int m, n, nnz; double *val; int *col, *row; } apl_sparse;
+
+#define sp_check(L,idx) ((apl_sparse *)luaL_checkudata(L,idx,"apl_sparse"))
+#define sp_test(L,idx) ((apl_sparse *)luaL_testudata(L,idx,"apl_sparse"))
+
+static apl_sparse *sp_new(lua_State *L, int m, int n, int nnz) {
+  apl_sparse *S=(apl_sparse *)lua_newuserdata(L,sizeof(apl_sparse)+
+     nnz*sizeof(double)+(nnz+m+1)*sizeof(int));
+  S->m=m; S->n=n; S->nnz=nnz;
+  S->val=(double *)(S+1);
+  S->col=(int *)(S->val+nnz);
+  S->row=S->col+nnz;
+  S->row[0]=0;
+  luaL_setmetatable(L,"apl_sparse");
+  return S;
+}
+
+/* position of (i,j) in S->val, or -1 if it is not stored */
+static int sp_find(const apl_sparse *S, int i, int j) {
+  int lo=S->row[i], hi=S->row[i+1]-1, k;
+  while (lo<=hi) {
+    k=(lo+hi)/2;
+    if (S->col[k]==j) return k;
+    if (S->col[k]<j) lo=k+1; else hi=k-1;
+  }
+  return -1;
+}
+
+static double sp_elem(const apl_sparse *S, int i, int j) {
+  int k=sp_find(S,i,j);
+  return k<0 ? 0 : S->val[k];
+}
+
+/* the matrix or vector at idx as a buffer of m×n doubles (n=0 for a 
+   vector); errors unless it is numeric */
+static double *sp_dense(lua_State *L, int idx, int *m, int *n) {
+  int k, l, rows=-1, cols=-1;
+  double *x;
+  luaL_checktype(L,idx,LUA_TTABLE);
+  apl_getshapeinfo(idx,l,rows,cols);
+  if (rows<0) { *m=l; *n=0; } else { *m=rows; *n=cols; }
+  x=(double *)lua_newuserdata(L,l*sizeof(double)+1);
+  for (k=0; k<l; k++) {
+    lua_rawgeti(L,idx,k+1);
+    luaL_argcheck(L,lua_type(L,-1)==LUA_TNUMBER,idx,"numeric array expected");
+    x[k]=lua_tonumber(L,-1);
+    lua_pop(L,1);
+  }
+  return x;
+}
+
+static void sp_setshape(lua_State *L, int res, int m, int n) {
+  lua_pushstring(L,"rows"); lua_pushinteger(L,m); lua_rawset(L,res); 
+  lua_pushstring(L,"cols"); lua_pushinteger(L,n); lua_rawset(L,res); 
+}
+
+/* sparse(a[,density]): the numeric matrix a as a sparse matrix. If 
+   density is given, returns nothing when a has more nonzeros than that 
+   fraction of its elements. */
+static int sp_sparse(lua_State *L) {
+  int i, j, k=0, m, n, nnz=0;
+  double *x, limit;
+  apl_sparse *S;
+  if (sp_test(L,1)) { lua_settop(L,1); return 1; }
+  limit=luaL_optnumber(L,2,1);
+  lua_settop(L,1);
+  x=sp_dense(L,1,&m,&n);
+  luaL_argcheck(L,n>0 || m==0,1,"matrix expected");
+  for (k=0; k<m*n; k++) if (x[k]!=0) nnz++;
+  if (nnz>limit*m*n) return 0;
+  S=sp_new(L,m,n,nnz);
+  for (i=0, k=0; i<m; i++) {
+    for (j=0; j<n; j++) if (x[i*n+j]!=0) { 
+      S->val[k]=x[i*n+j]; S->col[k++]=j; 
+    }
+    S->row[i+1]=k;
+  }
+  return 1;
+}
+
+/* dense(s): the sparse matrix s as an ordinary APL matrix */
+static int sp_todense(lua_State *L) {
+  apl_sparse *S=sp_check(L,1);
+  int i, k, res;
+  lua_settop(L,1);
+  lua_pushinteger(L,0);
+  core_new(L,S->m*S->n,2);
+  res=lua_gettop(L);
+  for (i=0; i<S->m; i++) for (k=S->row[i]; k<S->row[i+1]; k++) {
+    lua_pushnumber(L,S->val[k]);
+    lua_rawseti(L,res,i*S->n+S->col[k]+1);
+  }
+  sp_setshape(L,res,S->m,S->n);
+  return 1;
+}
+
+static int sp_issparse(lua_State *L) {
+  lua_pushboolean(L,sp_test(L,1)!=NULL);
+  return 1;
+}
+
+/* s.rows, s.cols, s.nnz, and s[k] for the elements in row-major order,
+   so that Lua code can read a sparse matrix like an APL matrix */
+static int sp_index(lua_State *L) {
+  apl_sparse *S=sp_check(L,1);
+  int k;
+  if (lua_type(L,2)==LUA_TNUMBER) {
+    k=lua_tointeger(L,2)-1;
+    if (k<0 || k>=S->m*S->n || k+1!=lua_tonumber(L,2)) return 0;
+    lua_pushnumber(L,sp_elem(S,k/S->n,k%S->n));
+    return 1;
+  }
+  if (lua_type(L,2)!=LUA_TSTRING) return 0;
+  if (!strcmp(lua_tostring(L,2),"rows")) lua_pushinteger(L,S->m);
+  else if (!strcmp(lua_tostring(L,2),"cols")) lua_pushinteger(L,S->n);
+  else if (!strcmp(lua_tostring(L,2),"nnz")) lua_pushinteger(L,S->nnz);
+  else return 0;
+  return 1;
+}
+
+static int sp_len(lua_State *L) {
+  apl_sparse *S=sp_check(L,1);
+  lua_pushinteger(L,S->m*S->n);
+  return 1;
+}
+
+/* transpose(s) */
+static int sp_transpose(lua_State *L) {
+  apl_sparse *S=sp_check(L,1), *T=sp_new(L,S->n,S->m,S->nnz);
+  int i, j, k, *next=(int *)lua_newuserdata(L,(S->n+1)*sizeof(int));
+  for (j=0; j<=S->n; j++) T->row[j]=0;
+  for (k=0; k<S->nnz; k++) T->row[S->col[k]+1]++;
+  for (j=0; j<S->n; j++) T->row[j+1]+=T->row[j];
+  for (j=0; j<S->n; j++) next[j]=T->row[j];
+  for (i=0; i<S->m; i++) for (k=S->row[i]; k<S->row[i+1]; k++) {
+    j=next[S->col[k]]++;
+    T->col[j]=i; T->val[j]=S->val[k];
+  }
+  lua_pop(L,1);
+  return 1;
+}
+
+/* get(s,i,j): element i,j; or row i if j is nil, column j if i is nil */
+static int sp_get(lua_State *L) {
+  apl_sparse *S=sp_check(L,1);
+  int i=luaL_optint(L,2,0), j=luaL_optint(L,3,0), k;
+  double *x;
+  luaL_argcheck(L,i>=0 && i<=S->m,2,"index out of range");
+  luaL_argcheck(L,j>=0 && j<=S->n,3,"index out of range");
+  if (i && j) { lua_pushnumber(L,sp_elem(S,i-1,j-1)); return 1; }
+  if (!i && !j) { lua_settop(L,1); return 1; }
+  if (i) {
+    x=(double *)lua_newuserdata(L,S->n*sizeof(double)+1);
+    for (k=0; k<S->n; k++) x[k]=0;
+    for (k=S->row[i-1]; k<S->row[i]; k++) x[S->col[k]]=S->val[k];
+    apl_array(L,x,S->n);
+  } else {
+    x=(double *)lua_newuserdata(L,S->m*sizeof(double)+1);
+    for (k=0; k<S->m; k++) x[k]=sp_elem(S,k,j-1);
+    apl_array(L,x,S->m);
+  }
+  return 1;
+}
+
+/* reduce(s,axis): +⌿s (axis 1) or +/s (axis 2) */
+static int sp_reduce(lua_State *L) {
+  apl_sparse *S=sp_check(L,1);
+  int axis=luaL_checkint(L,2), i, k, l = axis==1 ? S->n : S->m;
+  double *x=(double *)lua_newuserdata(L,l*sizeof(double)+1);
+  luaL_argcheck(L,axis==1 || axis==2,2,"axis must be 1 or 2");
+  for (k=0; k<l; k++) x[k]=0;
+  for (i=0; i<S->m; i++) for (k=S->row[i]; k<S->row[i+1]; k++) 
+    x[axis==1 ? S->col[k] : i] += S->val[k];
+  apl_array(L,x,l);
+  return 1;
+}
+
+static int sp_cmpint(const void *a, const void *b) {
+  return *(const int *)a - *(const int *)b;
+}
+
+/* product of sparse A and sparse B, Gustavson's method */
+static void sp_mulsparse(lua_State *L, apl_sparse *A, apl_sparse *B) {
+  int i, j, k, p, nnz=0, cnt, 
+    *mark=(int *)lua_newuserdata(L,(B->n+1)*sizeof(int)), *cols;
+  double *acc=(double *)lua_newuserdata(L,(B->n+1)*sizeof(double));
+  apl_sparse *C;
+  for (j=0; j<B->n; j++) mark[j]=-1;
+  for (i=0; i<A->m; i++) {  /* count the structural nonzeros */
+    for (k=A->row[i]; k<A->row[i+1]; k++) {
+      p=A->col[k];
+      for (j=B->row[p]; j<B->row[p+1]; j++) 
+        if (mark[B->col[j]]!=i) { mark[B->col[j]]=i; nnz++; }
+    }
+  }
+  cols=(int *)lua_newuserdata(L,(B->n+1)*sizeof(int));
+  C=sp_new(L,A->m,B->n,nnz);
+  for (j=0; j<B->n; j++) mark[j]=-1;
+  for (i=0, nnz=0; i<A->m; i++) {
+    cnt=0;
+    for (k=A->row[i]; k<A->row[i+1]; k++) {
+      p=A->col[k];
+      for (j=B->row[p]; j<B->row[p+1]; j++) {
+        int c=B->col[j];
+        if (mark[c]!=i) { mark[c]=i; acc[c]=0; cols[cnt++]=c; }
+        acc[c]+=A->val[k]*B->val[j];
+      }
+    }
+    qsort(cols,cnt,sizeof(int),sp_cmpint);
+    for (k=0; k<cnt; k++) if (acc[cols[k]]!=0) {
+      C->col[nnz]=cols[k]; C->val[nnz++]=acc[cols[k]];
+    }
+    C->row[i+1]=nnz;
+  }
+  C->nnz=nnz;  /* cancellation may leave some space unused */
+}
+
+/* mul(a,b): a+.×b where a or b or both are sparse. The result is sparse
+   if both are, otherwise an ordinary matrix, or a vector if the other 
+   argument is a vector. */
+static int sp_mul(lua_State *L) {
+  apl_sparse *A=sp_test(L,1), *B=sp_test(L,2);
+  int i, j, k, m, n, res;
+  double *x, *r;
+  if (A && B) {
+    luaL_argcheck(L,A->n==B->m,2,"size mismatch");
+    sp_mulsparse(L,A,B);
+    return 1;
+  }
+  if (A) {  /* sparse times dense */
+    x=sp_dense(L,2,&m,&n);
+    luaL_argcheck(L,m==A->n,2,"size mismatch");
+    if (!n) n=1;
+    r=(double *)lua_newuserdata(L,A->m*n*sizeof(double)+1);
+    for (i=0; i<A->m*n; i++) r[i]=0;
+    for (i=0; i<A->m; i++) for (k=A->row[i]; k<A->row[i+1]; k++) 
+      for (j=0; j<n; j++) r[i*n+j]+=A->val[k]*x[A->col[k]*n+j];
+    apl_array(L,r,A->m*n);
+    res=lua_gettop(L);
+    apl_getfield(L,2,"cols");
+    if (!lua_isnil(L,-1)) sp_setshape(L,res,A->m,n);
+    lua_settop(L,res);
+    return 1;
+  }
+  B=sp_check(L,2);  /* dense times sparse */
+  x=sp_dense(L,1,&m,&n);
+  if (!n) { n=m; m=1; }   /* a vector is a row */
+  luaL_argcheck(L,n==B->m,1,"size mismatch");
+  r=(double *)lua_newuserdata(L,m*B->n*sizeof(double)+1);
+  for (i=0; i<m*B->n; i++) r[i]=0;
+  for (i=0; i<m; i++) for (j=0; j<n; j++) if (x[i*n+j]!=0)
+    for (k=B->row[j]; k<B->row[j+1]; k++) 
+      r[i*B->n+B->col[k]]+=x[i*n+j]*B->val[k];
+  apl_array(L,r,m*B->n);
+  res=lua_gettop(L);
+  apl_getfield(L,1,"cols");
+  if (!lua_isnil(L,-1)) sp_setshape(L,res,m,B->n);
+  lua_settop(L,res);
+  return 1;
+}
+
+/* the comparisons and ∧, with tolerance as in testeq */
+static const char *const sp_ops[] = 
+  {"eq", "ne", "lt", "le", "gt", "ge", "and", NULL};
+
+static int sp_apply(int op, double w, double a, double act, double rct) {
+  switch (op) {
+    case 0: return cmp_num(CMP_EQ,w,a,act,rct);
+    case 1: return a!=w;
+    case 2: return a<w;
+    case 3: return cmp_num(CMP_LE,w,a,act,rct);
+    case 4: return a>w;
+    case 5: return cmp_num(CMP_GE,w,a,act,rct);
+    default: return w!=0 && a!=0;
+  }
+}
+
+/* outer(op,w,a,density[,act,rct]): ⍺ ∘.op ⍵ for numeric vectors as a 
+   sparse #a×#w matrix, or nothing if more than the fraction `density` 
+   of its elements would be nonzero */
+static int sp_outer(lua_State *L) {
+  int op=luaL_checkoption(L,1,NULL,sp_ops), i, j, k, m, n, mw, ma, nnz=0;
+  double *w, *a, density, act, rct;
+  apl_sparse *S;
+  if (!lua_istable(L,2) || !lua_istable(L,3)) return 0;
+  density=luaL_checknumber(L,4);
+  act=luaL_optnumber(L,5,0); rct=luaL_optnumber(L,6,0);
+  lua_settop(L,6);
+  w=sp_dense(L,2,&n,&mw); a=sp_dense(L,3,&m,&ma);
+  if (mw || ma) return 0;  /* matrices */
+  for (i=0; i<m; i++) for (j=0; j<n; j++) nnz+=sp_apply(op,w[j],a[i],act,rct);
+  if (nnz>density*m*n) return 0;
+  S=sp_new(L,m,n,nnz);
+  for (i=0, k=0; i<m; i++) {
+    for (j=0; j<n; j++) if (sp_apply(op,w[j],a[i],act,rct)) { 
+      S->val[k]=1; S->col[k++]=j; 
+    }
+    S->row[i+1]=k;
+  }
+  return 1;
+}
+
+/* and(w,a): ⍺∧⍵ where ⍺ or ⍵ is sparse; the other may be sparse, a 
+   matrix of the same shape or a scalar. The result is sparse. */
+static int sp_and(lua_State *L) {
+  apl_sparse *A=sp_test(L,1), *B=sp_test(L,2), *C;
+  int i, k, p, q, m, n, nnz=0, other;
+  double *x=NULL, s=1;
+  if (!A) { A=B; B=NULL; other=1; } else other=2;
+  if (!A) luaL_argerror(L,1,"sparse matrix expected");
+  if (B) luaL_argcheck(L,A->m==B->m && A->n==B->n,2,"size mismatch");
+  else if (lua_type(L,other)==LUA_TNUMBER) s=lua_tonumber(L,other);
+  else {
+    x=sp_dense(L,other,&m,&n);
+    luaL_argcheck(L,m==A->m && n==A->n,other,"size mismatch");
+  }
+#define sp_keep(i,k) (A->val[k]!=0 && s!=0 && \
+  (B ? (q=sp_find(B,i,A->col[k]))>=0 && B->val[q]!=0 : \
+   !x || x[i*A->n+A->col[k]]!=0))
+  for (i=0; i<A->m; i++) for (k=A->row[i]; k<A->row[i+1]; k++) 
+    if (sp_keep(i,k)) nnz++;
+  C=sp_new(L,A->m,A->n,nnz);
+  for (i=0, p=0; i<A->m; i++) {
+    for (k=A->row[i]; k<A->row[i+1]; k++) if (sp_keep(i,k)) {
+      C->val[p]=1; C->col[p++]=A->col[k];
+    }
+    C->row[i+1]=p;
+  }
+#undef sp_keep
+  return 1;
+}
+
+static const luaL_Reg sp_meta[] = {
+  {"__index", sp_index},
+  {"__len", sp_len},
+  {NULL, NULL}
+};
+
+/* ------------------------- Key package -------------------------- */
+
+/* key(k,v[,op]): groups the items of v by the corresponding items of k 
+   in a single hash pass. A non-table v counts as #k copies of itself.
+   If op is add, mul, max or min and v is numeric, returns a 2×g matrix 
+   whose rows are the g distinct keys in order of first occurrence and 
+   the reductions of their groups. Otherwise returns the distinct keys 
+   and, for each item of k, the number of its group. */
+static int apl_key(lua_State *L) {
+  int i, n, g=0, op=-1, *grp, hash, keys, res;
+  double *x=NULL, *acc, v=0;
+  luaL_checktype(L,1,LUA_TTABLE);
+  luaL_checkany(L,2);
+  if (!lua_isnoneornil(L,3)) {
+    op=luaL_checkoption(L,3,NULL,par_op2);
+    luaL_argcheck(L,op==OP_ADD||op==OP_MUL||op==OP_MAX||op==OP_MIN,
+      3,"only add, mul, max and min are associative");
+  }
+  lua_settop(L,3);
+  n=luaL_len(L,1);
+  if (lua_istable(L,2)) 
+    luaL_argcheck(L,luaL_len(L,2)==n,2,"length does not match the keys");
+  grp=(int *)lua_newuserdata(L,n*sizeof(int)+1);
+  lua_createtable(L,0,n); hash=lua_gettop(L);
+  lua_createtable(L,n,1); keys=lua_gettop(L);
+  for (i=0; i<n; i++) {
+    lua_rawgeti(L,1,i+1);
+    luaL_argcheck(L,!lua_isnil(L,-1) && 
+      (lua_type(L,-1)!=LUA_TNUMBER || lua_tonumber(L,-1)==lua_tonumber(L,-1)),
+      1,"keys may not be nil or NaN");
+    lua_pushvalue(L,-1); 
+    lua_rawget(L,hash);
+    if (lua_isnil(L,-1)) {
+      lua_pop(L,1);
+      lua_pushvalue(L,-1);
+      lua_rawseti(L,keys,++g);
+      lua_pushinteger(L,g);
+      lua_rawset(L,hash);
+      grp[i]=g;
+    } else {
+      grp[i]=lua_tointeger(L,-1);
+      lua_pop(L,2);
+    }
+  }
+  if (op>=0 && lua_istable(L,2)) { if (!(x=par_numbers(L,2,n))) op=-1; }
+  else if (lua_type(L,2)==LUA_TNUMBER) v=lua_tonumber(L,2);
+  else op=-1;
+  if (op<0) {
+    lua_pushinteger(L,g);
+    lua_setfield(L,keys,"apl_len");
+    apl_setmetatable(L,keys);
+    lua_pushvalue(L,keys);
+    core_new(L,n,0);
+    res=lua_gettop(L);
+    for (i=0; i<n; i++) { lua_pushinteger(L,grp[i]); lua_rawseti(L,res,i+1); }
+    return 2;
+  }
+  acc=(double *)lua_newuserdata(L,g*sizeof(double)+1);
+  for (i=0; i<g; i++) acc[i] = op==OP_ADD ? 0 : op==OP_MUL ? 1 : 
+    op==OP_MAX ? -HUGE_VAL : HUGE_VAL;
+  /* right to left, as in Reduce */
+  for (i=n-1; i>=0; i--) 
+    acc[grp[i]-1]=par_apply2(op,acc[grp[i]-1],x ? x[i] : v);
+  lua_pushinteger(L,0);
+  core_new(L,2*g,lua_gettop(L));
+  res=lua_gettop(L);
+  lua_pushstring(L,"rows"); lua_pushinteger(L,2); lua_rawset(L,res);
+  lua_pushstring(L,"cols"); lua_pushinteger(L,g); lua_rawset(L,res);
+  for (i=0; i<g; i++) {
+    lua_rawgeti(L,keys,i+1); lua_rawseti(L,res,i+1);
+    lua_pushnumber(L,acc[i]); lua_rawseti(L,res,g+i+1);
+  }
+  return 1;
+}
+
+/* ----------------------- Window package ------------------------- */
+
+/* Reductions of all windows of length w along a line of len numbers 
+   x[0], x[sx], ..., stored at r[0], r[sr], ... in O(len) time, using 
+   the scratch space at dq. For sums the line is cut into blocks of w 
+   numbers; a window is the tail of one block plus the head of the next,
+   so its sum adds two partial sums of its own numbers only. Nothing is 
+   ever subtracted, and a large or infinite number affects only the 
+   windows that contain it. Maxima and minima use a deque of candidate 
+   positions whose values decrease (max) or increase (min) from front to
+   back. */
+static void window_line(int op, const double *x, long sx, int len, int w,
+    double *r, long sr, void *scratch) {
+  int i, j, head=0, tail=0, *dq=(int *)scratch;
+  double sum, *tl=(double *)scratch;
+  if (op==OP_ADD) {
+    for (j=0; j<len; j+=w)     /* tl[i]: sum of the tail of i's block */
+      for (sum=0, i=(j+w<len ? j+w : len)-1; i>=j; i--) tl[i]=sum+=x[i*sx];
+    for (j=0, sum=0; j<len; j++) {  /* sum: head of j's block up to j */
+      sum = j%w ? sum+x[j*sx] : x[j*sx];
+      i=j-w+1;
+      if (i>=0) r[i*sr] = i%w ? tl[i]+sum : sum;
+    }
+    return;
+  }
+  for (i=0; i<len; i++) {
+    while (tail>head && (op==OP_MAX ? x[dq[tail-1]*sx]<=x[i*sx] 
+                                    : x[dq[tail-1]*sx]>=x[i*sx])) tail--;
+    dq[tail++]=i;
+    if (dq[head]<=i-w) head++;
+    if (i>=w-1) r[(i-w+1)*sr]=x[dq[head]*sx];
+  }
+}
+
+/* window(op,a,w[,axis]): op/ of every window of length w along the 
+   numeric array a, where op is add, max or min. A matrix is reduced
+   along its rows (axis 2, the default) or its columns (axis 1). Returns 
+   nothing if a is not numeric. */
+static int apl_window(lua_State *L) {
+  static const char *const ops[] = {"add", "max", "min", NULL};
+  static const int opcode[] = {OP_ADD, OP_MAX, OP_MIN};
+  int op=opcode[luaL_checkoption(L,1,NULL,ops)], w=luaL_checkint(L,3), 
+    axis=luaL_optint(L,4,2), len, m=-1, n=-1, matrix, size, lines, i, 
+    rm, rn, res;
+  long sx, sl, sr, rl;
+  double *x, *r;
+  void *scratch;
+  luaL_checktype(L,2,LUA_TTABLE);
+  luaL_argcheck(L,axis==1 || axis==2,4,"axis must be 1 or 2");
+  lua_settop(L,4);
+  apl_getshapeinfo(2,len,m,n);
+  matrix = n>=0;
+  if (!matrix) { m=1; n=len; axis=2; }
+  size = axis==2 ? n : m;
+  luaL_argcheck(L,w>0 && w<=size+1,3,"window size out of range");
+  if (!(x=par_numbers(L,2,len))) return 0;
+  if (axis==2) { lines=m; sx=1; sl=n; rm=m; rn=n-w+1; rl=rn; sr=1; }
+  else { lines=n; sx=n; sl=1; rm=m-w+1; rn=n; rl=1; sr=n; }
+  r=(double *)lua_newuserdata(L,(size_t)rm*rn*sizeof(double)+1);
+  scratch=lua_newuserdata(L,size*sizeof(double)+1);
+  if (size>=w) for (i=0; i<lines; i++) 
+    window_line(op,x+i*sl,sx,size,w,r+i*rl,sr,scratch);
+  apl_array(L,r,rm*rn);
+  if (matrix) {
+    res=lua_gettop(L);
+    lua_pushstring(L,"rows"); lua_pushinteger(L,rm); lua_rawset(L,res); 
+    lua_pushstring(L,"cols"); lua_pushinteger(L,rn); lua_rawset(L,res); 
+  }
+  return 1;
+}
+
+/* --------------------- Structural package ----------------------- */
+
+/* Catenation, reshape, disclose, compress and expand. Each kernel works
+   out the shape of its result first, creates it once with core_new and 
+   fills it in a single pass. They return nothing in the cases that 
+   apl.lua keeps for itself: arrays of rank 3 or more, empty results, 
+   counts that are not non-negative integers, and nested items that the 
+   Lua code would disclose. */
+
+/* Shape of the value at idx seen as a matrix: a vector is one row, a 
+   scalar is 1×1. Returns 0 for an array of rank 3 or more. */
+static int st_shape(lua_State *L, int idx, int *m, int *n) {
+  int l=1, rows=-1, cols=-1;
+  if (!lua_istable(L,idx)) { *m=*n=1; return 1; }
+  apl_getfield(L,idx,"shape");
+  if (!lua_isnil(L,-1)) { lua_pop(L,1); return 0; }
+  lua_pop(L,1);
+  apl_getshapeinfo(idx,l,rows,cols);
+  if (cols<0) { *m=1; *n=l; } else { *m=rows; *n=cols; }
+  return 1;
+}
+
+/* pushes item (i,j) of the value at idx, a matrix with n columns */
+static void st_item(lua_State *L, int idx, int i, int j, int n) {
+  if (lua_istable(L,idx)) lua_rawgeti(L,idx,(i-1)*n+j);
+  else lua_pushvalue(L,idx);
+}
+
+/* true if the vector at idx has a table among its items */
+static int st_nested(lua_State *L, int idx, int len) {
+  int i, nested=0;
+  for (i=1; i<=len && !nested; i++) { 
+    lua_rawgeti(L,idx,i); nested=lua_istable(L,-1); lua_pop(L,1); 
+  }
+  return nested;
+}
+
+/* replaces the value at top by its neutral item: '' if it is a string,
+   or if `deep` is set a table whose first item is a string, else 0 */
+static void st_filler(lua_State *L, int deep) {
+  if (deep && lua_istable(L,-1)) { lua_rawgeti(L,-1,1); lua_remove(L,-2); }
+  if (lua_type(L,-1)==LUA_TSTRING) { lua_pop(L,1); lua_pushliteral(L,""); }
+  else { lua_pop(L,1); lua_pushinteger(L,0); }
+}
+
+/* cat(w,a[,axis[,fill]]): a followed by w. Without an axis, the items 
+   of both, a scalar counting as one item. Along axis 1 (⍪) the rows of 
+   a and then those of w, padded with `fill` (default 0) to the longest;
+   along axis 2 (,) their columns, padded to the tallest. */
+static int st_cat(lua_State *L) {
+  int axis=luaL_optint(L,3,0), ma, na, mw, nw, m, n, i, j, k=0, res;
+  luaL_checkany(L,1); luaL_checkany(L,2);
+  if (lua_isnoneornil(L,4)) { lua_settop(L,3); lua_pushinteger(L,0); }
+  lua_settop(L,4);
+  if (axis==0) {
+    na = lua_istable(L,2) ? luaL_len(L,2) : 1;
+    nw = lua_istable(L,1) ? luaL_len(L,1) : 1;
+    core_new(L,na+nw,0); res=lua_gettop(L);
+    for (j=1; j<=na; j++) { st_item(L,2,1,j,na); lua_rawseti(L,res,++k); }
+    for (j=1; j<=nw; j++) { st_item(L,1,1,j,nw); lua_rawseti(L,res,++k); }
+    return 1;
+  }
+  luaL_argcheck(L,axis==1 || axis==2,3,"axis must be 1 or 2");
+  if (!st_shape(L,2,&ma,&na) || !st_shape(L,1,&mw,&nw)) return 0;
+  if (axis==1) { m=ma+mw; n=na>nw ? na : nw; }
+  else { 
+    if ((ma==1 && lua_istable(L,2) && st_nested(L,2,na)) ||
+        (mw==1 && lua_istable(L,1) && st_nested(L,1,nw))) return 0;
+    m=ma>mw ? ma : mw; n=na+nw; 
+  }
+  if ((long)m*n==0) return 0;
+  core_new(L,m*n,0); res=lua_gettop(L);
+  if (axis==1) {
+    for (i=1; i<=ma; i++) for (j=1; j<=n; j++) {
+      if (j<=na) st_item(L,2,i,j,na); else lua_pushvalue(L,4);
+      lua_rawseti(L,res,++k);
+    }
+    for (i=1; i<=mw; i++) for (j=1; j<=n; j++) {
+      if (j<=nw) st_item(L,1,i,j,nw); else lua_pushvalue(L,4);
+      lua_rawseti(L,res,++k);
+    }
+  } else for (i=1; i<=m; i++) {
+    for (j=1; j<=na; j++) {
+      if (i<=ma) st_item(L,2,i,j,na); else lua_pushvalue(L,4);
+      lua_rawseti(L,res,++k);
+    }
+    for (j=1; j<=nw; j++) {
+      if (i<=mw) st_item(L,1,i,j,nw); else lua_pushvalue(L,4);
+      lua_rawseti(L,res,++k);
+    }
+  }
+  sp_setshape(L,res,m,n);
+  return 1;
+}
+
+/* reshape(w,m[,n]): m items, or an m×n matrix, taken cyclically from 
+   the items of the table w */
+static int st_reshape(lua_State *L) {
+  int m=luaL_checkint(L,2), n=luaL_optint(L,3,-1), len, l, i, j=0;
+  luaL_checktype(L,1,LUA_TTABLE);
+  luaL_argcheck(L,m>=0,2,"negative dimension");
+  luaL_argcheck(L,n>=-1,3,"negative dimension");
+  l=luaL_len(L,1);
+  if (l==0) return 0;
+  len = n<0 ? m : m*n;
+  lua_settop(L,1);
+  core_new(L,len,0);
+  for (i=1; i<=len; i++) {
+    lua_rawgeti(L,1,++j); lua_rawseti(L,2,i);
+    if (j==l) j=0;
+  }
+  if (n>=0) sp_setshape(L,2,m,n);
+  return 1;
+}
+
+/* disclose(w,fill): the vector w of rows as a matrix, each row padded
+   with fill to the length of the longest; an item that is not a table 
+   is a row of one */
+static int st_disclose(lua_State *L) {
+  int m, n=1, l, i, j, k=0;
+  luaL_checktype(L,1,LUA_TTABLE);
+  luaL_checkany(L,2);
+  lua_settop(L,2);
+  m=luaL_len(L,1);
+  for (i=1; i<=m; i++) {
+    lua_rawgeti(L,1,i);
+    if (lua_istable(L,-1) && (l=luaL_len(L,-1))>n) n=l;
+    lua_pop(L,1);
+  }
+  core_new(L,m*n,0);
+  for (i=1; i<=m; i++) {
+    lua_rawgeti(L,1,i);
+    if (lua_istable(L,4)) {
+      l=luaL_len(L,4);
+      for (j=1; j<=l; j++) { lua_rawgeti(L,4,j); lua_rawseti(L,3,++k); }
+    } else { l=1; lua_pushvalue(L,4); lua_rawseti(L,3,++k); }
+    for (j=l+1; j<=n; j++) { lua_pushvalue(L,2); lua_rawseti(L,3,++k); }
+    lua_pop(L,1);
+  }
+  sp_setshape(L,3,m,n);
+  return 1;
+}
+
+/* The count for slice k of `len` in the counts at idx, a table or a 
+   number standing for all of them, or -1 if it is not a non-negative 
+   integer. */
+static long st_count(lua_State *L, int idx, int k) {
+  lua_Number x;
+  int isnum;
+  if (lua_istable(L,idx)) lua_rawgeti(L,idx,k); else lua_pushvalue(L,idx);
+  x=lua_tonumberx(L,-1,&isnum);
+  lua_pop(L,1);
+  return isnum && x>=0 && x==floor(x) && x<INT_MAX ? (long)x : -1;
+}
+
+/* Checks the counts at idx against `len` slices and returns their sum, 
+   or -1 if the kernel should leave the case to apl.lua. A number is 
+   accepted only if `scalar` is set. */
+static long st_counts(lua_State *L, int idx, int len, int scalar) {
+  long sum=0, c;
+  int k;
+  if (!lua_istable(L,idx)) {
+    if (!scalar || (c=st_count(L,idx,1))<0) return -1;
+    return c*len;
+  }
+  if (luaL_len(L,idx)!=len || len<2) return -1;
+  for (k=1; k<=len; k++) {
+    if ((c=st_count(L,idx,k))<0) return -1;
+    sum+=c;
+  }
+  return sum;
+}
+
+/* Common set-up of compress and expand: the shape of w and the slices 
+   to work on, which are its items (no axis or a vector), rows (axis 1)
+   or columns (axis 2). */
+static int st_slices(lua_State *L, int *axis, int *m, int *n) {
+  int l=-1;
+  *axis=luaL_optint(L,3,0); *m=*n=-1;
+  if (!lua_istable(L,1)) return -1;
+  apl_getfield(L,1,"shape");
+  if (!lua_isnil(L,-1)) return -1;
+  lua_pop(L,1);
+  apl_getshapeinfo(1,l,*m,*n);
+  if (*n<0 || *axis==0) { *axis=0; *m=1; *n=l; }
+  return *axis==1 ? *m : *n;
+}
+
+/* compress(w,a[,axis]): each item of w, or row (axis 1) or column 
+   (axis 2) of the matrix w, as many times as the corresponding count 
+   in the table a */
+static int st_compress(lua_State *L) {
+  int axis, m, n, len, rm, rn, i, j, c, k=0, res;
+  long sum;
+  luaL_checkany(L,2);
+  lua_settop(L,3);
+  if ((len=st_slices(L,&axis,&m,&n))<0) return 0;
+  if ((sum=st_counts(L,2,len,0))<=0) return 0;
+  if (axis==1) { rm=sum; rn=n; } else { rm=m; rn=sum; }
+  if ((long)rm*rn==0) return 0;
+  core_new(L,rm*rn,0); res=lua_gettop(L);
+  if (axis==1) for (i=1; i<=m; i++) {
+    for (c=st_count(L,2,i); c>0; c--) for (j=1; j<=n; j++) {
+      lua_rawgeti(L,1,(i-1)*n+j); lua_rawseti(L,res,++k);
+    }
+  } else for (i=1; i<=m; i++) for (j=1; j<=n; j++) {
+    for (c=st_count(L,2,j); c>0; c--) {
+      lua_rawgeti(L,1,(i-1)*n+j); lua_rawseti(L,res,++k);
+    }
+  }
+  if (axis) sp_setshape(L,res,rm,rn);
+  return 1;
+}
+
+/* expand(w,a[,axis]): each item of w, or row (axis 1) or column (axis 
+   2) of the matrix w, preceded by as many neutral ones as the 
+   corresponding count in a, or as a if it is a number */
+static int st_expand(lua_State *L) {
+  int axis, m, n, len, rm, rn, i, j, c, k=0, res, fill;
+  long sum;
+  luaL_checkany(L,2);
+  lua_settop(L,3);
+  if ((len=st_slices(L,&axis,&m,&n))<0) return 0;
+  if ((sum=st_counts(L,2,len,1))<0) return 0;
+  if (axis==1) { rm=m+sum; rn=n; } else { rm=m; rn=n+sum; }
+  if ((long)rm*rn==0) return 0;
+  /* a neutral row or column has the filler of its neighbour on top, and
+     below or after it the filler of the first slice in the result */
+  if (axis) {
+    lua_rawgeti(L,1,1); st_filler(L,0);
+    if (st_count(L,2,1)==0) { lua_pop(L,1); lua_pushinteger(L,0); }
+  }
+  else lua_pushnil(L);
+  fill=lua_gettop(L);
+  core_new(L,rm*rn,0); res=lua_gettop(L);
+  if (axis==1) for (i=1; i<=m; i++) {
+    for (c=st_count(L,2,i); c>0; c--) {
+      lua_rawgeti(L,1,(i-1)*n+1); st_filler(L,0); lua_rawseti(L,res,++k);
+      for (j=2; j<=n; j++) { lua_pushvalue(L,fill); lua_rawseti(L,res,++k); }
+    }
+    for (j=1; j<=n; j++) { lua_rawgeti(L,1,(i-1)*n+j); lua_rawseti(L,res,++k); }
+  } else for (i=1; i<=m; i++) for (j=1; j<=n; j++) {
+    for (c=st_count(L,2,j); c>0; c--) {
+      if (axis && i>1) lua_pushvalue(L,fill); 
+      else { lua_rawgeti(L,1,j); st_filler(L,!axis); }
+      lua_rawseti(L,res,++k);
+    }
+    lua_rawgeti(L,1,(i-1)*n+j); lua_rawseti(L,res,++k);
+  }
+  if (axis) sp_setshape(L,res,rm,rn);
+  return 1;
+}
+
+/* -------------------- Delimited text package -------------------- */
+
+#define CSV_BUFSIZE 65536
+#define CSV_FIELD 255
+#define CSV_BLOCK 65536
+
+/* A stream delivers the numbers in a file a chunk at a time: raw 
+   doubles in native byte order, or the fields of delimited text in 
+   row-major order, in which case the first `skip` lines are ignored. */
+typedef struct { FILE *fp; int binary, skip, atline; char delim; } 
+  apl_stream;
+
+#define stream_check(L,idx) \
+  ((apl_stream *)luaL_checkudata(L,idx,"apl_stream"))
+
+/* The field f[0..len) as a number, or NaN if it is empty or not a 
+   number. There is room for f[len]. */
+static double csv_number(char *f, int len) {
+  char *end;
+  double x;
+  while (len>0 && isspace((unsigned char)f[len-1])) len--;
+  while (len>0 && isspace((unsigned char)*f)) { f++; len--; }
+  if (len>=2 && f[0]=='"' && f[len-1]=='"') { f++; len-=2; }
+  f[len]=0;
+  x=strtod(f,&end);
+  return len==0 || *end ? NAN : x;
+}
+
+/* Stores v as field k (from 1) in the blocks of CSV_BLOCK doubles in the
+   table at index `blocks`, starting a new block as needed. *x is the 
+   current block. */
+static void csv_put(lua_State *L, int blocks, double **x, int k, double v) {
+  int j=(k-1)%CSV_BLOCK;
+  if (j==0) {
+    mem_check(L,CSV_BLOCK*sizeof(double));
+    *x=(double *)lua_newuserdata(L,CSV_BLOCK*sizeof(double));
+    lua_rawseti(L,blocks,(k-1)/CSV_BLOCK+1);
+  }
+  (*x)[j]=v;
+}
+
+#define csv_store(L,k,f,len) csv_put(L,blocks,&x,k,csv_number(f,len))
+
+#define csv_fail(...) return luaL_error(L,__VA_ARGS__)
+#define csv_endrow \
+  if (rows==0) cols=ncol; \
+  else if (ncol!=cols) csv_fail("%s:%d: expected %d fields, found %d", \
+     fname,line,cols,ncol); \
+  rows++; ncol=0; line++; start=1;
+
+/* readcsv(filename[,delim[,skip]]): the numbers in a delimited text file
+   as a rows×cols matrix. The file is read in chunks of CSV_BUFSIZE bytes 
+   and parsed into blocks of doubles, which are copied into a table of 
+   the right size at the end. Lines end in \n or \r\n, fields are 
+   separated by delim (default ","), the first `skip` lines (default 0)
+   are ignored, and so are blank lines. Empty and non-numeric fields 
+   become NaN. Every row must have the same number of fields. The file
+   is held by an apl_stream, whose __gc closes it if an error occurs. */
+static int io_readcsv(lua_State *L) {
+  const char *fname=luaL_checkstring(L,1), *delim=luaL_optstring(L,2,",");
+  int skip=luaL_optint(L,3,0), len=0, k=0, rows=0, cols=0, ncol=0, 
+    line=1, start=1, blocks, tbl, b, j;
+  char *buf, field[CSV_FIELD+1];
+  double *x=NULL;
+  size_t got, i;
+  apl_stream *S;
+  luaL_argcheck(L,strlen(delim)==1,2,"delimiter must be one character");
+  buf=(char *)lua_newuserdata(L,CSV_BUFSIZE);
+  lua_newtable(L);
+  blocks=lua_gettop(L);
+  S=(apl_stream *)lua_newuserdata(L,sizeof(apl_stream));
+  S->fp=NULL;
+  luaL_setmetatable(L,"apl_stream");
+  if (!(S->fp=fopen(fname,"rb"))) return luaL_error(L,"cannot open %s",fname);
+  while ((got=fread(buf,1,CSV_BUFSIZE,S->fp))>0) {
+    if (apl_interrupted) { apl_interrupted=0; csv_fail("interrupted!"); }
+    for (i=0; i<got; i++) {
+      char c=buf[i];
+      if (skip>0) { if (c=='\n') { skip--; line++; } continue; }
+      if (c=='\r') continue;
+      if (c=='\n' && start) { line++; continue; }
+      if (c==*delim || c=='\n') {
+        csv_store(L,++k,field,len);
+        len=0; ncol++; start=0;
+        if (c=='\n') { csv_endrow }
+      } else {
+        if (len==CSV_FIELD) csv_fail("%s:%d: field too long",fname,line);
+        field[len++]=c; start=0;
+      }
+    }
+  }
+  if (!start) {  /* no newline at the end */
+    csv_store(L,++k,field,len); ncol++; 
+    csv_endrow
+  }
+  fclose(S->fp);
+  S->fp=NULL;
+  mem_check(L,MEM_TABLE+(size_t)k*MEM_TVALUE);
+  lua_createtable(L,k,3);
+  tbl=lua_gettop(L);
+  for (b=0; b*CSV_BLOCK<k; b++) {
+    lua_rawgeti(L,blocks,b+1);
+    x=(double *)lua_touserdata(L,-1);
+    lua_pop(L,1);
+    for (j=0; j<CSV_BLOCK && b*CSV_BLOCK+j<k; j++) {
+      lua_pushnumber(L,x[j]); 
+      lua_rawseti(L,tbl,b*CSV_BLOCK+j+1);
+    }
+  }
+  lua_pushinteger(L,k); lua_setfield(L,tbl,"apl_len");
+  lua_pushinteger(L,rows); lua_setfield(L,tbl,"rows");
+  lua_pushinteger(L,cols); lua_setfield(L,tbl,"cols");
+  apl_setmetatable(L,tbl);
+  return 1;
+}
+#undef csv_fail
+#undef csv_endrow
+
+static void stream_start(apl_stream *S) {
+  int c, skip=S->skip;
+  rewind(S->fp);
+  S->atline=1;
+  if (!S->binary) while (skip>0 && (c=getc(S->fp))!=EOF) 
+    if (c=='\n') skip--;
+}
+
+/* stream(filename[,format[,skip]]): format is "double" for raw doubles, 
+   otherwise the one-character delimiter of a text file (default ","). */
+static int stream_open(lua_State *L) {
+  const char *fname=luaL_checkstring(L,1), *format=luaL_optstring(L,2,",");
+  int skip=luaL_optint(L,3,0), binary=!strcmp(format,"double");
+  apl_stream *S;
+  luaL_argcheck(L,binary || strlen(format)==1,2,
+    "expected \"double\" or a one-character delimiter");
+  S=(apl_stream *)lua_newuserdata(L,sizeof(apl_stream));
+  S->fp=NULL;
+  S->binary=binary;
+  S->delim=*format;
+  S->skip=skip;
+  luaL_setmetatable(L,"apl_stream");
+  if (!(S->fp=fopen(fname,S->binary ? "rb" : "r"))) 
+    return luaL_error(L,"cannot open %s",fname);
+  stream_start(S);
+  return 1;
+}
+
+/* Reads the next field of a text stream into x. Returns 0 at the end. */
+static int stream_field(lua_State *L, apl_stream *S, double *x) {
+  char f[CSV_FIELD+1];
+  int c, len=0;
+  for (;;) {
+    c=getc(S->fp);
+    if (c=='\r') continue;
+    if (c==EOF && len==0 && S->atline) return 0;
+    if (c=='\n' && len==0 && S->atline) continue;  /* blank line */
+    if (c==EOF || c=='\n' || c==S->delim) break;
+    if (len==CSV_FIELD) luaL_error(L,"field too long");
+    f[len++]=c; 
+    S->atline=0;
+  }
+  S->atline = c!=S->delim;
+  *x=csv_number(f,len);
+  return 1;
+}
+
+/* chunk(s,n): vector of the next n or fewer numbers of the stream s, or 
+   nothing at the end */
+static int stream_chunk(lua_State *L) {
+  apl_stream *S=stream_check(L,1);
+  int n=luaL_checkint(L,2), k=0;
+  double *x;
+  luaL_argcheck(L,n>0,2,"chunk size must be positive");
+  luaL_argcheck(L,S->fp!=NULL,1,"stream is closed");
+  x=(double *)lua_newuserdata(L,n*sizeof(double));
+  if (S->binary) k=fread(x,sizeof(double),n,S->fp);
+  else while (k<n && stream_field(L,S,x+k)) k++;
+  if (k==0) return 0;
+  apl_array(L,x,k);
+  return 1;
+}
+
+/* restart(s): the next chunk of s starts at the beginning again */
+static int stream_restart(lua_State *L) {
+  apl_stream *S=stream_check(L,1);
+  luaL_argcheck(L,S->fp!=NULL,1,"stream is closed");
+  stream_start(S);
+  return 0;
+}
+
+static int stream_close(lua_State *L) {
+  apl_stream *S=stream_check(L,1);
+  if (S->fp) fclose(S->fp);
+  S->fp=NULL;
+  return 0;
+}
+
+static int stream_isstream(lua_State *L) {
+  lua_pushboolean(L,luaL_testudata(L,1,"apl_stream")!=NULL);
+  return 1;
+}
+
+void dgesvd_(char *jobu, char *jobvt, int *m, int *n, double *a, int* lda,
+  double *s,  double *u, int *ldu,  double *vt, int *ldvt, 
+  double *work, int *lwork, int *info);
+
+void dsyevd_(char *jobz, char *uplo, int *n, double *a, int *lda, 
+  double *w, double *work, int *lwork, int *iwork, int *liwork, int *info);
+void dpotrf_(char *uplo, int *n, double *a, int *lda, int *info);
+void dgesv_(int *n, int *nrhs, double *a, int *lda, int *ipiv, 
+  double *b, int *ldb, int *info);
+void dgeqrf_(int *m, int *n, double *a, int *lda, double *tau, 
+  double *work, int *lwork, int *info);
+void dorgqr_(int *m, int *n, int *k, double *a, int *lda, double *tau, 
+  double *work, int *lwork, int *info);
+
+/* Scratch space for LAPACK lives in userdata on the stack, so that it 
+   is collected even when an error is raised. */
+#define lapack_buffer(L,type,len) \
+  ((type *)lua_newuserdata(L,(len)*sizeof(type)+1))
+
+/* Copies the numeric matrix (or vector, as one column) at `idx` in a 
+   single pass to a new buffer in the column-major order of LAPACK. */
+static double *lapack_matrix(lua_State *L, int idx, int *m, int *n) {
+  int i, j, l, rows=-1, cols=-1;
+  double *a;
+  luaL_checktype(L,idx,LUA_TTABLE);
+  apl_getshapeinfo(idx,l,rows,cols);
+  if (rows<0) { rows=l; cols=1; }
+  luaL_argcheck(L,rows>0 && cols>0,idx,"nonempty APL matrix required");
+  a=lapack_buffer(L,double,rows*cols);
+  for (i=0; i<rows; i++) for (j=0; j<cols; j++) {
+    lua_rawgeti(L,idx,i*cols+j+1);
+    luaL_argcheck(L,lua_type(L,-1)==LUA_TNUMBER,idx,"numeric matrix required");
+    a[i+j*rows]=lua_tonumber(L,-1);
+    lua_pop(L,1);
+  }
+  *m=rows; *n=cols;
+  return a;
+}
+
+/* Pushes the m×n matrix in column-major `a` with leading dimension lda
+   as an APL matrix, with the part below the diagonal zeroed if `upper`. 
+   A matrix with one column becomes a vector if `vector`. */
+static void lapack_result(lua_State *L, const double *a, int lda, int m, 
+   int n, int upper, int vector) {
+  int i, j, res;
+  core_new(L,m*n,0);
+  res=lua_gettop(L);
+  for (i=0; i<m; i++) for (j=0; j<n; j++) {
+    lua_pushnumber(L, upper && i>j ? 0 : a[i+j*lda]);
+    lua_rawseti(L,res,i*n+j+1);
+  }
+  if (vector && n==1) return;
+  lua_pushstring(L,"rows"); lua_pushinteger(L,m); lua_rawset(L,res); 
+  lua_pushstring(L,"cols"); lua_pushinteger(L,n); lua_rawset(L,res); 
+}
+
+/* svd(a) returns u,s,v; u and v as nested arrays */
+static int apl_svd(lua_State *L) {
+  int i,l,m=0,n=0,info,lw;
+  double *a, *u, *s, *vt, *w, w0;
+  luaL_argcheck(L,lua_gettop(L)<2,2,"too many arguments");
+  luaL_checktype(L,1,LUA_TTABLE);
+  apl_getshapeinfo(1,l,m,n);
+  luaL_argcheck(L, m>0 && n>0, 1, "nonempty APL matrix required");
+  l = m<n? m :n;
+  a = lapack_buffer(L,double,m*n);
+  u = lapack_buffer(L,double,n*l);
+  s = lapack_buffer(L,double,l);
+  vt = lapack_buffer(L,double,l*m);
+  /* row-major a is column-major a', so no transposition is needed */
+  for (i=1; i<=m*n; i++) {
+    lua_rawgeti(L,1,i); a[i-1]=lua_tonumber(L,-1); lua_pop(L,1);
+  }
+  apl_checkinterrupt(L);       /* LAPACK itself cannot be interrupted */
+  lw=-1;
+  dgesvd_("S","S",&n,&m,a,&n,s,u,&n,vt,&l,&w0,&lw,&info);
+  if (info==0) lw=(int)w0;
+  if (info==0) {
+    w=lapack_buffer(L,double,lw);
+    dgesvd_("S","S",&n,&m,a,&n,s,u,&n,vt,&l,w,&lw,&info);
+    if (info!=0) { lua_pushinteger(L,info); return 1; }
+  }
+  else { luaL_error(L,"error on first call to dgesvd, info=%d\n",info); }
+  apl_array(L,u,l*n); 
+  apl_array(L,s,l);
+  apl_array(L,vt,l*m);
+  return 3;
+}
+
+/* eig(a) returns the eigenvalues of the symmetric matrix a in ascending
+   order and the matrix with the corresponding eigenvectors as columns.
+   Only the upper triangle of a is referenced. */
+static int apl_eig(lua_State *L) {
+  int m, n, info, lw=-1, liw=-1, iw0;
+  double *a, *e, w0;
+  a=lapack_matrix(L,1,&m,&n);
+  luaL_argcheck(L,m==n,1,"square matrix required");
+  e=lapack_buffer(L,double,n);
+  dsyevd_("V","U",&n,a,&n,e,&w0,&lw,&iw0,&liw,&info);
+  if (info==0) {
+    lw=(int)w0; liw=iw0;
+    dsyevd_("V","U",&n,a,&n,e,lapack_buffer(L,double,lw),&lw,
+       lapack_buffer(L,int,liw),&liw,&info);
+  }
+  if (info!=0) luaL_error(L,"eigenvalues failed to converge, info=%d",info);
+  apl_array(L,e,n);
+  lapack_result(L,a,n,n,n,0,0);
+  return 2;
+}
+
+/* chol(a) returns the upper triangular r with r'r = a for a symmetric 
+   positive definite matrix a */
+static int apl_chol(lua_State *L) {
+  int m, n, info;
+  double *a=lapack_matrix(L,1,&m,&n);
+  luaL_argcheck(L,m==n,1,"square matrix required");
+  dpotrf_("U",&n,a,&n,&info);
+  if (info>0) luaL_error(L,"matrix is not positive definite");
+  lapack_result(L,a,n,n,n,1,0);
+  return 1;
+}
+
+/* solve(a,b) returns x with a x = b by LU decomposition; b and x may 
+   be vectors or matrices */
+static int apl_solve(lua_State *L) {
+  int m, n, k, nrhs, info, rows=-1;
+  double *a=lapack_matrix(L,1,&m,&n), *b=lapack_matrix(L,2,&k,&nrhs);
+  luaL_argcheck(L,m==n,1,"square matrix required");
+  luaL_argcheck(L,k==n,2,"number of rows must match the matrix");
+  apl_intfield(L,2,"rows",rows);
+  dgesv_(&n,&nrhs,a,&n,lapack_buffer(L,int,n),b,&n,&info);
+  if (info>0) luaL_error(L,"matrix is singular");
+  lapack_result(L,b,n,n,nrhs,0,rows<0);
+  return 1;
+}
+
+/* qr(a) returns q,r with a = q r; for an m×n matrix a and k=min(m,n), 
+   q is m×k with orthonormal columns and r is k×n upper triangular */
+static int apl_qr(lua_State *L) {
+  int m, n, k, r, info, lw=-1;
+  double *a, *tau, *w, w0;
+  a=lapack_matrix(L,1,&m,&n);
+  k = m<n ? m : n;
+  tau=lapack_buffer(L,double,k);
+  dgeqrf_(&m,&n,a,&m,tau,&w0,&lw,&info);
+  if (info==0) {
+    lw=(int)w0;
+    w=lapack_buffer(L,double,lw);
+    dgeqrf_(&m,&n,a,&m,tau,w,&lw,&info);
+  }
+  if (info!=0) luaL_error(L,"QR factorization failed, info=%d",info);
+  lapack_result(L,a,m,k,n,1,0);
+  r=lua_gettop(L);
+  lw=-1;
+  dorgqr_(&m,&k,&k,a,&m,tau,&w0,&lw,&info);
+  if (info==0) {
+    lw=(int)w0;
+    w=lapack_buffer(L,double,lw);
+    dorgqr_(&m,&k,&k,a,&m,tau,w,&lw,&info);
+  }
+  if (info!=0) luaL_error(L,"QR factorization failed, info=%d",info);
+  lapack_result(L,a,m,m,k,0,0);  /* q */
+  lua_pushvalue(L,r);
+  return 2;
 }
 
 static int arr_index(lua_State *L) {
@@ -563,12 +3074,65 @@ static const luaL_Reg funcs[] = {
   {"keep", tuple_keep},
   {"where", lua_where},
   {"is_int", core_is_int},
+  {"hash", core_hash},
+  {"utflen", core_utflen},
+  {"utfsplit", core_utfsplit},
+  {"utfsub", core_utfsub},
+  {"text", text_new},
+  {"istext", text_istext},
+  {"textsub", text_sub},
+  {"texteq", text_eq},
+  {"textfind", text_find},
   {"rho", apl_rho},
   {"iota", apl_iota},
   {"both", apl_both},
   {"each", apl_each},
   {"svd", apl_svd},
+  {"eig", apl_eig},
+  {"chol", apl_chol},
+  {"solve", apl_solve},
+  {"qr", apl_qr},
+  {"roll", apl_roll},
+  {"deal", apl_deal},
+  {"seed", rng_setseed},
   {"compat", apl_compat},
+  {"decode", apl_decode},
+  {"encode", apl_encode},
+  {"threads", par_threads},
+  {"map1", par_map1},
+  {"map2", par_map2},
+  {"reduce", par_reduce},
+  {"outer", par_outer},
+  {"gather", par_gather},
+  {"sparse", sp_sparse},
+  {"dense", sp_todense},
+  {"issparse", sp_issparse},
+  {"sptranspose", sp_transpose},
+  {"spget", sp_get},
+  {"spreduce", sp_reduce},
+  {"spmul", sp_mul},
+  {"spouter", sp_outer},
+  {"spand", sp_and},
+  {"key", apl_key},
+  {"strided", nd_strided},
+  {"readcsv", io_readcsv},
+  {"stream", stream_open},
+  {"chunk", stream_chunk},
+  {"restart", stream_restart},
+  {"close", stream_close},
+  {"isstream", stream_isstream},
+  {"window", apl_window},
+  {"cat", st_cat},
+  {"reshape", st_reshape},
+  {"disclose", st_disclose},
+  {"compress", st_compress},
+  {"expand", st_expand},
+  {"memory", mem_memory},
+  {"sizeof", mem_sizeof},
+  {"progress", apl_setprogress},
+  {"testeq", apl_testeq},
+  {"testge", apl_testge},
+  {"testle", apl_testle},
   {"circ0", math_circ0},
   {"circ4", math_circ4},
   {"circ_4", math_circ_4},
@@ -588,6 +3152,21 @@ static const luaL_Reg apl_meta[] = {
 LUAMOD_API int luaopen_apl_core (lua_State *L) {
   luaL_newlib(L, apl_meta);
   lua_setfield(L,LUA_REGISTRYINDEX,"apl_meta");
+  rng_seed((apl_rng *)lua_newuserdata(L,sizeof(apl_rng)),0,0);
+  lua_setfield(L,LUA_REGISTRYINDEX,"apl_rng");
+  par_init(L);
+  lua_pushlightuserdata(L,(void *)&apl_interrupted);
+  lua_setfield(L,LUA_REGISTRYINDEX,"apl_interrupt");
+  luaL_newmetatable(L,"apl_sparse");
+  luaL_setfuncs(L,sp_meta,0);
+  lua_pop(L,1);
+  luaL_newmetatable(L,"apl_text");
+  luaL_setfuncs(L,text_meta,0);
+  lua_pop(L,1);
+  luaL_newmetatable(L,"apl_stream");
+  lua_pushcfunction(L,stream_close);
+  lua_setfield(L,-2,"__gc");
+  lua_pop(L,1);
   luaL_newlib(L, funcs);
   return 1;
 }
@@ -9,9 +9,12 @@ end
 
 local _VERSION = "Lua⋆APL 0.4.1"
 _APL_LEVEL = _APL_LEVEL or 2
+local startup = os.clock()
 
 -- You can set global _APL_LEVEL before requiring this module. 
 -- It's mainly a debugging tool. See discussion in the Programmer's Guide.
+-- If global _APL_FAST is true, the module loads without a logfile or a
+-- banner, and help texts are only stored when help is first asked for.
 
 -- External modules
 
@@ -21,8 +24,21 @@ local help=require"help"
 
 -- The main module table 'apl' and some of its subtables
 
-local load_apl
-local apl_meta = {__call = function(apl,code) return load_apl(code) end }
+local load_apl, chunked
+local constant = setmetatable({},{__mode='k'}) -- arrays hoisted by compiler
+local version = setmetatable({},{__mode='k'})  -- modifications by Set
+local apl_meta = {__call = function(apl,code) return load_apl(code) end,
+   __index = function(apl,key)   -- some control variables live in core
+      if key=='_memory' then return core.memory"limit" 
+      elseif key=='_progress' then return core.progress()
+      end
+   end,
+   __newindex = function(apl,key,val)
+      if key=='_memory' then core.memory(val or 0) 
+      elseif key=='_progress' then core.progress(val)
+      else rawset(apl,key,val) 
+      end
+   end }
 local arr_meta = getmetatable(core.rho(0,0)) 
 local core_index,core_newindex = arr_meta.__index,arr_meta.__newindex
 local util                                          -- utility routines
@@ -31,25 +47,63 @@ local APL_ENV = {_V=_V}       -- environment for compiled APL functions
 local apl_dict = {}                            -- APL-to-Lua dictionary
 local lua_dict                                 -- Lua-to-APL dictionary 
 local unit                            -- units of some dyadic functions
+local scalar_fn                       -- names of the scalar primitives
 
 local apl=setmetatable({APL_ENV=APL_ENV}, apl_meta)
 
 -- Debugging aids 
 
 local loading=true
-local logfile = io.open("/tmp/apl-lua.log","w")
+local logfile = _APL_FAST and {write=function() end} or
+   io.open("/tmp/apl-lua.log","w")
 local where=core.where
 
 local meta_ENV=getmetatable(_ENV)
-setmetatable(_ENV,{__newindex = function (ENV,name,value)
+if not _APL_FAST then setmetatable(_ENV,{__newindex = function (ENV,name,value)
    logfile:write(where(2),"Assigning _ENV.",name,"\n")
    rawset(ENV,name,value)
-end})
+end}) end
+
+-- help_from(target,source) gives `target` the help text of `source`.
+-- In fast mode, help texts defined while loading are kept in `pending`
+-- and stored only when help is asked for after loading.
+local help_from = function(target,source) help(target,help(source,0)) end
+if _APL_FAST then
+   local store, pending = help, {}
+   local flush
+   flush = function(topic)
+      local p = pending[topic]
+      pending[topic] = nil
+      if p.source then 
+         if pending[p.source] then flush(p.source) end
+         store(topic,store(p.source,0))
+      else store(topic,p.text)
+      end
+   end
+   help = function(topic,...)
+      if pending then
+         if select('#',...)==1 and type(...)=='string' then
+            if loading then pending[topic]={text=...}; return end
+            pending[topic]=nil
+         elseif not loading then
+            while next(pending) do flush((next(pending))) end
+            pending=nil
+         end
+      end
+      return store(topic,...)
+   end
+   help_from = function(target,source)
+      if target==source then return end
+      if pending then pending[target]={source=source}
+      else store(target,store(source,0))
+      end
+   end
+end
 
 -- forward declaration of util routines
 local all, argcheck, arr, both, checksize, checktype, compat, each,
-  filler, get, invert, iota, is, is_int, is_matrix, is_not, replace, 
-  rho, same, set, shape, singleton, start, sum, utfchar, utflen
+  filler, get, invert, iota, is, is_int, is_matrix, is_not, plain, 
+  replace, rho, same, set, shape, singleton, start, sum, utfchar, utflen
 
           do --## local scope for util
 
@@ -211,13 +265,11 @@ local Vector = _s^0*number*(_s^1*number)^0
 
 local first = R"az"+R"AZ"+"_"
 local later = first+R"09"
-local ascii = R"\x00\x7F"                -- 7-bit ASCII
 local utc = R"\x80\xBF"                  -- UTF-8 continuation byte
 local utf2 = R"\xC0\xDF"*utc             -- 2-byte codepoint
 local utf3 = R"\xE0\xEF"*utc*utc         -- 3-byte codepoint
 local utf4 = R"\xF0\xF7"*utc*utc*utc     -- 4-byte codepoint
 local utf5 = R"\xF8\xFD"*utc*utc*utc*utc -- 5-byte codepoint
-local utf8 = ascii + utf2 + utf3 + utf4 +utf5  -- any codepoint
 local utf = utf2 + utf3 + utf4 +utf5 - P"←"-P"¯"
 local neutral = R"\x21\x7E"-later-S"()[;]"  
 local name = first*later^0 + utf + neutral
@@ -261,7 +313,8 @@ local apl_expr = P { "statement";
       + (Var*'['*indices*']'/"%1[%2]" + Var)/"_V.%1" 
       + (Param*'['*indices*']'/"%1[%2]" + Param)/1;
    index = expr+_s^0/"'*'";
-   indices = index*';'*index/"{%1;%2}" + index;
+   indices = Ct(index*(';'*index)^1)/function(t) 
+      return '{'..concat(t,';')..'}' end + index;
    }
 
 local apl2lua
@@ -289,6 +342,23 @@ local registry={[0]=Reserved, [1]=Monadic_functions, [2]=Dyadic_functions,
 -- Class 7 is not used by the module itself. It is there for ambivalent 
 --    user functions.  
  
+local signature  -- identifies the dictionary, reset whenever it changes
+local registry_signature = function()
+--- string listing all registered APL names, used as part of cache keys
+   if not signature then
+      local t={}
+      for code=1,6 do 
+         local class=registry[code]
+         if is"table"(class) then for k,v in pairs(class) do 
+            t[#t+1]=code..k..'='..v 
+         end end
+      end
+      table.sort(t)
+      signature=concat(t,'\n')
+   end
+   return signature
+end
+
 local register
 register = function (code, fct, APLname, LuaName, alias, helptext)
 --- register(code, fct, APLname, LuaName, alias, help)
@@ -330,6 +400,7 @@ register = function (code, fct, APLname, LuaName, alias, helptext)
    logfile:write((" (%s)\n"):format(tostring(fct)))  
 
    class[APLname]=LuaName
+   signature=nil
    local dict=apl_dict[APLname]
    if dict then dict[#dict+1]=LuaName
    else apl_dict[APLname]={LuaName} 
@@ -340,30 +411,244 @@ register = function (code, fct, APLname, LuaName, alias, helptext)
    if helptext then help(fct,helptext) end
 end
 
+local register_table = function(code, mapping, funcs, alias)
+--- register_table(code, mapping, funcs, alias)
+-- Register every `LuaName=APLname` pair in `mapping` as `register` would, 
+--   taking the functions from `funcs` and alternative APL names from 
+--   `alias[APLname]`, but without the checks and the logging. Only meant 
+--   for the predefined tables, which are known to be consistent.
+   local class=registry[code]
+   for LuaName,APLname in pairs(mapping) do
+      local fct=funcs[LuaName]
+      if fct then
+         class[APLname]=LuaName
+         local dict=apl_dict[APLname]
+         if dict then dict[#dict+1]=LuaName
+         else apl_dict[APLname]={LuaName} 
+         end
+         if alias and alias[APLname] then class[alias[APLname]]=LuaName end
+         apl[LuaName]=fct
+         APL_ENV[LuaName]=fct
+      end
+   end
+   signature=nil
+end
+
 local preamble=[[local _w,_a=... 
 ]]
 
+--- Constant hoisting. Literal vectors, and pure primitives applied to 
+-- constants only, are evaluated once and become locals of a factory:
+--    local _K = ...
+--    local _K1 = _K[1] or Constant({1,2,3})
+--    return function(...) <preamble><body> end
+-- The factory is called with the values computed here; a factory read 
+-- back from the bytecode cache is called with {} and rebuilds them.
+local factory_head = "local _K = ...\n"
+local factory_body = "return function(...)\n"..preamble
+local foldable, fold_op = {}, {}
+for fn in ([[Abs Add Attach1 Attach2 Binom Circ Decode Div Drop Encode Exp 
+   Fact Ln Log Max Min Mul Pi Pow Range Ravel Recip Reshape Reverse1 
+   Reverse2 Rotate1 Rotate2 Shape Sign Sub Take Transpose Unm]]):gmatch"%w+" 
+   do foldable[fn]=true end
+for op in ("Each Inner Outer Reduce1 Reduce2 Scan1 Scan2"):gmatch"%w+" 
+   do fold_op[op]=true end
+
+local hoist = function(lua)
+   local strings, names, source, values = {}, {}, {}, {}
+   local env = setmetatable({},{__index=APL_ENV})
+   lua = lua:gsub("'[^']*'",function(s)    -- keep string literals apart
+      strings[#strings+1]=s; return "\1"..#strings.."\1" end)
+   local expand
+   expand = function(text) 
+      return (text:gsub("_K(%d+)",function(k) return source[tonumber(k)] end))
+   end
+   local new = function(text,value)
+      text = expand(text)
+      if names[text] then return names[text] end
+      local k = #source+1
+      source[k], values[k], names[text] = text, value, "_K"..k
+      env["_K"..k] = value
+      if type(value)=='table' then constant[value]=true end
+      return "_K"..k
+   end
+   local fold = function(call,args)
+      for a in (args:sub(2,-2)..','):gmatch"([^,]*)," do 
+         if not (tonumber(a) or a:match"^_K%d+$") then return end
+      end
+      local ok,val = pcall(load("return "..call..args,nil,nil,env))
+      if ok and (type(val)=='number' or is"table"(val)) then 
+         return new(call..args,val) 
+      end
+   end
+   lua = lua:gsub("{[-%d.eE,]+}",function(t) 
+      return new(t,load("return "..t)()) end)
+   local old
+   repeat old = lua
+      lua = lua:gsub("%f[%w_.](%u%w*)(%([%w,]*%))(%([^()]*%))",
+         function(op,fns,args)
+            if not fold_op[op] then return end
+            for fn in fns:gmatch"%w+" do 
+               if not foldable[fn] then return end
+            end
+            return fold(op..fns,args)
+         end)
+      lua = lua:gsub("%f[%w_.](%u%w*)(%([^()]*%))",function(fn,args)
+         if foldable[fn] then return fold(fn,args) end
+      end)
+   until lua==old
+   -- A constant returned as the value of the function may be modified 
+   -- by the caller, so it is built afresh on each call.
+   lua = lua:gsub("return (_K%d+)$",function(k) 
+      return "return "..expand(k) end)
+   local head, used = {factory_head}, {}
+   for k in lua:gmatch"_K(%d+)" do used[tonumber(k)]=true end
+   if not next(used) then return end
+   for k,text in ipairs(source) do if used[k] then
+      head[#head+1] = 
+         ("local _K%d = _K[%d] or Constant(%s)\n"):format(k,k,text)
+   end end
+   lua = lua:gsub("\1(%d+)\1",function(k) return strings[tonumber(k)] end)
+   return concat(head)..factory_body..lua.."\nend", values
+end
+
+--- Bytecode cache, active only when `apl._cache` names a directory.
+-- A file holds the length of the APL code, the code itself (to guard
+-- against hash collisions) and the output of `string.dump`.
+local cache_name = function(_w)
+   return ("%s/%s.luac"):format(apl._cache,
+      core.hash(concat({_VERSION,registry_signature(),_w},'\0')))
+end
+
+local cache_load = function(_w)
+   local file = io.open(cache_name(_w),"rb")
+   if not file then return end
+   local code = file:read"*a"
+   file:close()
+   local n,pos = code:match"^(%d+)\n()"
+   n = tonumber(n)
+   if not n or code:sub(pos,pos+n-1)~=_w then return end
+   local f = load(code:sub(pos+n),nil,"b",APL_ENV)
+   if f and debug.getinfo(f,'S').source:sub(1,#factory_head)==factory_head
+      then f = f{} end
+   return f
+end
+
+local cache_store = function(_w,f)
+   local name = cache_name(_w)
+   local tmp = name.."."..core.hash(tostring{}..os.time()..os.clock())
+   local file = io.open(tmp,"wb")
+   if not file then return end   -- cache is best-effort only
+   local ok = file:write(#_w,"\n",_w,string.dump(f))
+   file:close()
+   if not (ok and os.rename(tmp,name)) then os.remove(tmp) end
+end
+
 local assignment = Name*(P'['*(1-P']')^0*P']')^0*'←'
 load_apl = function(_w)
    checktype(_w,'string',1)
    _w = _w:gsub("⍝[^\n]+"," "):gsub("\n"," ")  -- strip off APL comments
+   local cache = apl._cache
+   local f = cache and cache_load(_w)
+   if f then help(f,_w); return f end
    local lua = apl2lua(_w)
    if select(2,_w:gsub('⋄',''))==0 and not assignment:match(_w) and not
       lua:match"^return" then lua="return "..lua end
-   local f,msg = load(preamble..lua,nil,nil,APL_ENV)
+   local msg
+   local factory, values
+   if apl._fold then factory, values = hoist(lua) end
+   f,msg = load(factory or preamble..lua,nil,nil,APL_ENV)
    if not f then 
       error("Could not compile: ".._w.."\n Tried: "..lua.."\n"..msg) 
    end
+   if cache then cache_store(_w,f) end
+   if factory then f = f(values) end
    help(f,_w)
    return f   
 end
 
+chunked = function(_w,size)
+--- Chunked(code,size): function evaluating the APL reduction `f/expr` 
+-- with every stream named in expr bound to `size` elements at a time
+   checktype(_w,'string',1,'Chunked')
+   size = size or 65536
+   _w = _w:gsub("⍝[^\n]+"," "):gsub("\n"," ")
+   local lua = apl2lua(_w)
+   local fname, expr = lua:match"^Reduce[12]%((%w+)%)(%b())$"
+   local f = fname and APL_ENV[fname]
+   argcheck(f and unit[f],1,"expected f/⍵ with f one of + × ⌈ ⌊ ∧ ∨",
+      'Chunked')
+   -- only scalar functions of names and constants are elementwise
+   local scalar = true
+   local rest = expr:gsub("'[^']*'","0"):gsub("_V%.[%a_][%w_]*","0")
+      :gsub("([%a_][%w_]*)%(",function(name) 
+         scalar = scalar and scalar_fn[name]; return "(" end)
+   argcheck(scalar and not rest:find"[^%d%.eE%+%-%(%),%s]",1,
+      "not an elementwise expression of the streams",'Chunked')
+   local g,msg = load(preamble.."return "..expr,nil,nil,APL_ENV)
+   if not g then 
+      error("Could not compile: ".._w.."\n Tried: "..expr.."\n"..msg) 
+   end
+   local names = {}
+   for name in expr:gmatch"_V%.([%w_]+)" do names[name]=true end
+   local run = function(streams,partial)
+      local reduce = APL_ENV.Reduce2(f)
+      while true do
+         local n
+         for name,s in pairs(streams) do
+            local chunk = core.chunk(s,size)
+            local m = chunk and #chunk or 0
+            argcheck(n==nil or m==n,1,"streams of different lengths",
+               'Chunked')
+            n = m
+            rawset(_V,name,chunk)
+         end
+         if n==0 then return end
+         local val = g()
+         argcheck(is"table"(val) and #val==n,1,
+            "not an elementwise expression of the streams",'Chunked')
+         partial[#partial+1] = reduce(val)
+      end
+   end
+   local res = function()
+      local streams, saved, partial = {}, {}, {}
+      for name in pairs(names) do
+         local v = _V[name]
+         if core.isstream(v) then 
+            streams[name] = v; saved[name] = rawget(_V,name)
+            core.restart(v)
+         else argcheck(not is"table"(v),1,
+            "not an elementwise expression of the streams",'Chunked')
+         end
+      end
+      argcheck(next(streams),1,"no stream in ".._w,'Chunked')
+      local ok,msg = pcall(run,streams,partial)
+      for name in pairs(streams) do rawset(_V,name,saved[name]) end
+      if not ok then error(msg,0) end
+      local n = #partial
+      if n==0 then return unit[f] end
+      local res = partial[n]
+      for k=n-1,1,-1 do res=f(res,partial[k]) end
+      return res
+   end
+   help(res,_w)
+   return res
+end
+
 local function lua_code(_w)
 --- lua(f): Lua code of function f
    if is"function"(_w) then 
       local source = debug.getinfo(_w).source
       if source:sub(1,#preamble)==preamble then 
           source=source:sub(#preamble+1)
+      elseif source:sub(1,#factory_head)==factory_head then
+          local const = {}    -- show hoisted constants as written
+          for k,text in source:gmatch
+             "local _K(%d+) = _K%[%d+%] or Constant(%b())\n" do
+             const[k] = text:sub(2,-2)
+          end
+          local i = source:find(factory_body,1,true)
+          source = source:sub(i+#factory_body,-5):gsub("_K(%d+)",const)
       end
       return source
    else return "Not a function"
@@ -372,6 +657,7 @@ end
 
 apl.lua = lua_code
 apl.register = register
+apl.register_table = register_table
 
 help('method',nil)
 
@@ -390,9 +676,10 @@ apl.help = function(topic,...)
    if #h>0 then print(concat(h,'\n')) else return help(topic,...) end 
 end
 
-utfchar = function(s) return arr((Ct((utf8/1)^0)*-1):match(s)) end
-utflen = function(s) return #(utfchar(s)) end
-util.utfchar, util.utflen = utfchar, utflen
+-- One Lua string per codepoint is cheap: short strings are interned, so
+-- each distinct character is stored once and the array holds references.
+utfchar, utflen = core.utfsplit, core.utflen
+util.utfchar, util.utflen, util.utfsub = utfchar, utflen, core.utfsub
 
           end   -- local scope for compiler
 
@@ -422,6 +709,8 @@ apl.import = function(apl,names)
    end
 end
 
+local workspace = {}     -- global names assigned from APL, see Memory
+
 local Assign = function(_w,_a,ij)
    argcheck(_w,'⍵',"Can't assign nil to an APL name","Assign")  
    if is"function"(_w) then
@@ -431,12 +720,19 @@ local Assign = function(_w,_a,ij)
    local global_name = _a:match"_(.+)"      -- global assignment? If so,
    _a = global_name or _a                   -- strip off one underscore.
    local ENV = global_name and _ENV or _V   -- Select namespace
+   if global_name then workspace[_a]=true end
+   if constant[_w] then                     -- names never share constants
+      local copy = {}
+      for k,v in next,_w do copy[k]=v end
+      _w = setmetatable(copy,getmetatable(_w))
+   end
    if not ij then 
       ENV[_a]=_w 
       return _w 
    end
    _a = ENV[_a]; checktype(_a,'table','_a')
    _a[ij]=_w   
+   version[_a] = (version[_a] or 0) + 1
    return _w 
 end
 
@@ -446,6 +742,55 @@ local Define = function(_w)
 end
 
 local Execute = function(_w) return load_apl(_w)() end
+local kb = function(n) return ("%.1f KB"):format(n/1024) end
+local memory_meta = {__tostring = function(M)
+   local names, lines = {}, {}
+   for name in pairs(M.names) do names[#names+1]=name end
+   table.sort(names,function(a,b) return M.names[a]>M.names[b] end)
+   for _,name in ipairs(names) do 
+      lines[#lines+1]=("%-16s %12s  %s"):format(name,kb(M.names[name]),
+         M.rep[name])
+   end
+   lines[#lines+1]=("%-16s %12s  in use %s, peak %s%s"):format("total",
+      kb(M.total),kb(M.used),kb(M.peak),
+      M.limit and ", limit "..kb(M.limit) or "")
+   return table.concat(lines,"\n")
+end}
+
+local Memory = function(_w)
+   if _w~=nil then
+      argcheck(_w=="reset",1,'expected "reset" or nothing',"Memory")
+      core.memory"reset"
+      return
+   end
+   local names = {}
+   for name,v in next,_V do names[#names+1]=name end
+   for name in pairs(workspace) do 
+      if rawget(_ENV,name)~=nil then names[#names+1]=name 
+      else workspace[name]=nil
+      end
+   end
+   table.sort(names)
+   local M = {names={}, rep={}, bytes={}, total=0}
+   local seen = {}
+   for _,name in ipairs(names) do 
+      local v = rawget(_V,name)
+      if v==nil then v = rawget(_ENV,name) end
+      if type(v)~='function' then
+         local n, rep = core.sizeof(v,seen)
+         M.names[name], M.rep[name] = n, rep
+         M.bytes[rep] = (M.bytes[rep] or 0) + n
+         M.total = M.total + n
+      end
+   end
+   M.used, M.peak, M.limit = core.memory()
+   return setmetatable(M,memory_meta)
+end
+
+local Constant = function(_w)
+   if type(_w)=='table' then constant[_w]=true end
+   return _w
+end
 local Length = function(x) return #x end
 local Print = function(_w) print(_w); return _w end
 local Input = function(prompt)
@@ -462,6 +807,29 @@ register(0,Input,'⍞','Input',nil,[[
 Input(_w): ⍞ returns a line typed in; ⎕ returns the result of executing it.
    In Lua mode, `_w` must be ⍞ or ⎕. See also ⎕.]]) 
 
+register(0,Memory,'','Memory',nil,[[
+Memory(): bytes taken by each variable of the workspace (`names`), their 
+   representation (`rep`), totals by representation (`bytes`) and overall
+   (`total`), and bytes in use by Lua (`used`), their peak (`peak`) and
+   the soft limit `apl._memory` (`limit`). An array shared by several 
+   names is counted under the first in alphabetical order.
+Memory"reset": the peak restarts from the bytes now in use.]])
+register(0,Constant,'','Constant',nil,[[
+Constant(⍵): marks ⍵ as read-only, so that Set refuses to modify it and 
+   Assign binds a name to a copy. Used for constants hoisted by the 
+   compiler, see `help"_fold"`.]])
+register(0,chunked,'','Chunked',nil,[[
+Chunked(code,size): function that evaluates the APL reduction f/⍵, for f
+   one of + × ⌈ ⌊ ∧ ∨, on `size` elements (default 65536) at a time. Every 
+   stream named in ⍵ is bound to its next chunk, and the partial results 
+   are combined by f. ⍵ may only apply scalar functions to streams and 
+   scalar constants. See Stream.]])
+register(0,core.stream,'','Stream',nil,[[
+Stream(filename,format,skip): numbers in a file, to be read a chunk at a 
+   time by Chunked. format is "double" for raw doubles, otherwise the 
+   delimiter of a text file (default ","), whose first skip lines are 
+   ignored.]])
+
 apl.f1 = {Length=Length, Print=Print, Define=Define,Execute=Execute}
 help(Define,[[
 Define: ∇s returns APL code `s` compiled as a Lua function
@@ -549,29 +917,22 @@ Pow = function(_w,_a) return _a^_w end
 Range = core.iota
 Recip = function(_w) return 1/_w end
 Reshape = core.rho
-Roll = math.random 
+Roll = core.roll
 Same = function(_w,_a) return iverson(same(_a,_w)) end
 Set = core.newindex
 Sign = function(_w) return _w<0 and -1 or _w>0 and 1 or 0 end 
 Sub = function(_w,_a) return _a-_w end
 
-TestEq = function(_w,_a) 
-   local _act, _rct = apl._act, apl._rct
-   if _a==_w then return 1 end
-   if _act and abs(_w-_a)<_act then return 1 end
-   if _rct and abs(_w-_a)<_rct*abs(_w) then return 1 end
-   return 0
-end
+-- The tolerant comparisons work on whole arrays in the core
+local testeq, testge, testle = core.testeq, core.testge, core.testle
 
-TestGE = function(_w,_a) 
-   if _a>_w then return 1 else return TestEq(_w,_a) end
-end
+TestEq = function(_w,_a) return testeq(_w,_a,apl._act,apl._rct) end
+
+TestGE = function(_w,_a) return testge(_w,_a,apl._act,apl._rct) end
 
 TestGT = function(_w,_a) return iverson(_a>_w) end
 
-TestLE = function(_w,_a) 
-   if _a<_w then return 1 else return TestEq(_w,_a) end
-end
+TestLE = function(_w,_a) return testle(_w,_a,apl._act,apl._rct) end
 
 TestLT = function(_w,_a) return iverson(_a<_w) end
 TestNE = function(_w,_a) return iverson(_a~=_w) end
@@ -610,7 +971,7 @@ end
 
 Unm = function(_w) return -_w end
 
-local lib = {Get=core.index,NaN=NaN,Set=core.newindex}
+local lib = {Get=core.index,NaN=NaN,Seed=core.seed,Set=core.newindex}
 
 local f1={Abs=Abs, Ceil=Ceil, Exp=Exp, Fact=Fact, Floor=Floor, Ln=Ln, 
   Not=Not, Pi=Pi, Recip=Recip, Roll=Roll, Sign=Sign, Unm=Unm}
@@ -658,7 +1019,11 @@ local helptext = {
 Range: ⍳⍵ → first ⍵ integers starting at 1
        ⍺⍳⍵ → first ⍵ integers starting at ⍺ ]];
 [Reshape] = "Reshape: ⍺⍴⍵ → data given by ⍵, shape given by ⍺";
-[Roll] = "Roll: ?⍵ → Lua's math.random(⍵)";
+[Roll] = [[
+Roll: ?⍵ → random integer from 1 to ⍵, or random number in [0,1) if ⍵=0]];
+[core.seed] = [[
+Seed(seed[,stream]): restart the random number generator used by ? 
+   Each stream of a seed is an independent, reproducible sequence.]];
 [Same] = "Same: ⍺≡⍵ means Lua equality but APL 0-1 result";
 [Sign] = "Sign: ×⍵ is ¯1,0,1 according to whether ⍵ is <0, =0, >0";
 [Sub] = "Sub: ⍺-⍵ → Lua's _a-_w";
@@ -678,42 +1043,115 @@ for k,v in pairs(helptext) do help(k,v) end
 
           if _APL_LEVEL>0 then --## vector functions
 
+-- Texts and sparse matrices are userdata. plain(x,name,keep_sparse) 
+-- gives a text as an ordinary array of characters and refuses a sparse
+-- matrix unless keep_sparse is set. Anything else is returned unchanged.
+local istext, issparse, sparse = core.istext, core.issparse, core.sparse
+plain = function(x,name,keep_sparse)
+   if type(x)~='userdata' then return x end
+   if istext(x) then return utfchar(tostring(x)) end
+   if not keep_sparse and issparse(x) then 
+      error(name..": sparse matrix not supported, use Dense",2)
+   end
+   return x
+end
+
 -- term-by-term versions of primitive scalar functions
 
 for k,v in pairs(apl.rank0.f1) do
-   local f = function(_w,_a) return each(v,_w) end
-   help(f,help(v,0))
+   local f = function(_w,_a) 
+      if type(_w)=='userdata' then _w=plain(_w,k) end
+      return each(v,_w) 
+   end
+   help_from(f,v)
    apl.f1[k] = f
 end
 
 for k,v in pairs(apl.rank0.f2) do 
-   local f = function(_w,_a) return both(v,_w,_a,1,1) end
-   help(f,help(v,0))
+   local f = function(_w,_a) 
+      if type(_w)=='userdata' or type(_a)=='userdata' then 
+         _w, _a = plain(_w,k), plain(_a,k)
+      end
+      return both(v,_w,_a,1,1) 
+   end
+   help_from(f,v)
    apl.f2[k] = f 
 end
 
+-- vectorized in the core
+apl.f1.Roll = apl.rank0.f1.Roll
+apl.f2.TestEq = apl.rank0.f2.TestEq
+apl.f2.TestGE = apl.rank0.f2.TestGE
+apl.f2.TestLE = apl.rank0.f2.TestLE
+
+-- Numeric arrays go to kernels in the core that use several threads on
+-- large arrays. The kernels return nothing for anything else.
+local map1, map2 = core.map1, core.map2
+local native = {}  -- native[f] is the name of f in the core
+for k,op in pairs{Abs='abs', Ceil='ceil', Exp='exp', Floor='floor', 
+      Ln='ln', Recip='recip', Unm='unm'} do
+   local f = apl.f1[k]
+   apl.f1[k] = function(_w) return map1(op,_w) or f(_w) end
+   help_from(apl.f1[k],f)
+end
+for k,op in pairs{Add='add', Sub='sub', Mul='mul', Div='div', Max='max',
+      Min='min', Pow='pow', Mod='mod'} do
+   local f = apl.f2[k]
+   apl.f2[k] = function(_w,_a) return map2(op,_w,_a) or f(_w,_a) end
+   help_from(apl.f2[k],f)
+   native[apl.f2[k]] = op
+end
+
+-- Comparisons and ∧ give sparse matrices when apl._sparse is set and 
+-- the result is sparse enough. Sparse arguments are only allowed for ∧.
+-- = and ≠ compare texts in the core.
+local texteq = core.texteq
+local sparse_op = {}  -- sparse_op[f] is the name of f in core.spouter
+for k,op in pairs{TestEq='eq', TestNE='ne', TestLT='lt', TestLE='le', 
+      TestGT='gt', TestGE='ge', And='and'} do
+   local f = apl.f2[k]
+   apl.f2[k] = function(_w,_a)
+      if type(_w)=='userdata' or type(_a)=='userdata' then
+         if op=='and' and (issparse(_w) or issparse(_a)) then 
+            return core.spand(_w,_a)
+         end
+         local res = (op=='eq' or op=='ne') and texteq(_w,_a,op=='ne')
+         if res then return res end
+         _w, _a = plain(_w,k), plain(_a,k)
+      end
+      local res = f(_w,_a)
+      local d = apl._sparse
+      return d and type(res)=='table' and rawget(res,'cols') and 
+         sparse(res,d) or res
+   end
+   help_from(apl.f2[k],f)
+   sparse_op[apl.f2[k]] = op
+end
+
 -- new functions
 
 local Copy, Disclose, Down, Enclose, MatInv, Pass, Ravel, Reverse, Shape, 
    SVD, Transpose, Up   
 local Attach, Compress, Deal, Decode, Drop, Encode, Expand, Find, Format, 
    Has, Get, MatDiv, Rerank, Reshape, Rotate, Same, Set, Take 
-local Each, Outer, Reduce, Scan
+local Each, Key, Outer, Reduce, Scan
 local Inner
+local Memo
 
 local transpose=core.transpose
+local gather, outer, reduce = core.gather, core.outer, core.reduce
 local rawformat=apl.f1.ToString
-local abs,max,min,random = math.abs,math.max,math.min,math.random
+local abs,max,min = math.abs,math.max,math.min
 local sort,      unpack,      concat,       format = 
 table.sort,table.unpack,table.concat,string.format
 
 Attach = function(_w,_a)
-   _w=arr(_w); _a=arr(_a)
-   local k,l = #_a,#_w
-   return set(set(rho(0,k+l),1,k,unpack(_a)),k+1,k+l,unpack(_w))   
+   return core.cat(_w,_a)
 end
 
 Compress = function(_w,_a)
+   local res = core.compress(_w,_a)
+   if res then return res end
    if is_not"table"(_w) then _w={_w} end
    local n,v = 1,_a
    local ista = is"table"(_a)
@@ -723,7 +1161,7 @@ Compress = function(_w,_a)
      else checksize(_w,_a,1,"Compress")
      end
    end 
-   local res=rho(0,sum(_a))
+   res=rho(0,sum(_a))
    n=0
    for k,wk in ipairs(_w) do       
       if ista then v=_a[k] end
@@ -736,19 +1174,15 @@ Copy = function(_w)
    if is_not"table"(_w) then return _w end
    local res=rho(0,shape(_w))
    if #_w>0 then set(res,1,nil,unpack(_w)) end
+   rawset(res,'shape',rawget(_w,'shape'))
    return res
 end
 
 Deal = function(_w,_a)
-   local n=_w
    checktype(_w,"number",'⍵','Deal')
-   argcheck(_a<=n,'pair',"can't deal ".._a.." from "..n)
-   local p=iota(n)
-   for k=0,n-1 do 
-      local j=k+random(n-k) 
-      p[k+1],p[j],_w = p[j],p[k+1],_w-1 
-   end
-   return Take(p,_a)
+   checktype(_a,"number",'⍺','Deal')
+   argcheck(_a<=_w,'pair',"can't deal ".._a.." from ".._w)
+   return core.deal(_a,_w)
 end
 
 Decode = function(_w,_a)   
@@ -764,21 +1198,9 @@ end
 
 Disclose = function(_w) 
    if is"string"(_w) then return (apl._split or utfchar)(_w) end 
-   local m,n = shape(_w)
+   local _,n = shape(_w)
    argcheck(not n,1,"can't disclose a matrix")
-   n=1
-   for i,v in ipairs(_w) do
-      if is"table"(v) then n=max(n,#v) end 
-   end
-   local res=rho(filler(_w),m,n)
-   local j=1
-   for i,v in ipairs(_w) do      
-     if is_not"table"(v) then res[j]=v 
-        else set(res,j,nil,unpack(_w[i]))
-     end 
-     j=j+n 
-   end
-   return res
+   return core.disclose(_w,filler(_w))
 end
 
 Down = function(_w) 
@@ -830,6 +1252,8 @@ Encode = function(_w,_a)
    end
 
 Expand = function(_w,_a)
+   local res = core.expand(_w,_a)
+   if res then return res end
    if is_not"table"(_w) then _w={_w} end
    local m,n,v = 1,1,_a
    local ista = is"table"(_a)
@@ -840,7 +1264,7 @@ Expand = function(_w,_a)
      end
    end 
    if not ista then m=#_w*v else m=sum(_a) end
-   local res=rho(0,#_w+m)
+   res=rho(0,#_w+m)
    n=0
    for k,wk in ipairs(_w) do       
       if ista then v=_a[k] end
@@ -854,7 +1278,8 @@ Find = function(_w,_a)
    if is_not"table"(_a) then _a={_a} end
    local past=#_a+1
    if is_not"table"(_w) then
-      return first(function(x) return x==_w end,_a) or past
+      for k=1,#_a do if _a[k]==_w then return k end end
+      return past
    end
    local lookup=invert(_a)
    local res=Copy(_w)
@@ -909,6 +1334,8 @@ Get = function(_w,_a)
    if _a=='*' then _a=iota(#_w) end
    local m,n = shape(_a)
    if not m then return core_index(_w,_a) end
+   local res=gather(_w,_a)
+   if res then return res end
    res=rho(0,m,n) 
    for k=1,#_a do res[k]=_w[_a[k]] end
    return res
@@ -933,14 +1360,46 @@ end
 
 local Add, Mul, Div = apl.f2.Add, apl.f2.Mul, apl.f2.Div
 local dot=Inner(Add,Mul)
+Key = function(f)
+   checktype(f,'function',1)
+   local op=native[f]
+   if op~='add' and op~='mul' and op~='max' and op~='min' then op=nil end
+   return function(_w,_a)
+      if _a==nil then _w,_a = 1,_w end
+      checktype(_a,'table',2,'Key')
+      argcheck(is_not"table"(_w) or #_w==#_a,'pair',
+         "⍺ and ⍵ have different lengths",'Key')
+      local res,grp = core.key(_a,_w,op)
+      if not grp then return res end
+      local g,ista,acc = #res,is"table"(_w),{}
+      for k=#grp,1,-1 do   -- right to left, as in Reduce
+         local j,v = grp[k],_w
+         if ista then v=_w[k] end
+         if acc[j]==nil then acc[j]=v else acc[j]=f(acc[j],v) end
+      end
+      local keys=res
+      res=rho(0,2,g)
+      for j=1,g do res[j]=keys[j]; res[g+j]=acc[j] end
+      return res
+   end
+end
+
 MatDiv = function(_w,_a) return dot(_w,_a)/dot(_w,_w) end
 MatInv = function(_w) return Div(dot(_w,_w),_w) end
 
 Outer = function(f) 
    checktype(f,'function',f)
+   local op, spop = native[f], sparse_op[f]
    return function(_w,_a)
+      if is"table"(_w) and rawget(_w,'shape') or 
+         is"table"(_a) and rawget(_a,'shape') then
+         error("Outer: rank 3 or more not supported",2)
+      end
+      local res = op and outer(op,_w,_a) or spop and apl._sparse and
+         core.spouter(spop,_w,_a,apl._sparse,apl._act,apl._rct)
+      if res then return res end
       local n,m =#_w,#_a
-      local res=rho(0,m,n)
+      res=rho(0,m,n)
       local k=0
       for i=1,m do for j=1,n do
          k=k+1; res[k] = f(_w[j],_a[i])
@@ -951,20 +1410,58 @@ end
 
 Ravel = function(_w) 
    if is_not"table"(_w) then return rho(_w,1) end
-   _w=Copy(_w); _w.rows=nil; _w.cols=nil
+   _w=Copy(_w); rawset(_w,'rows',nil); rawset(_w,'cols',nil)
+   rawset(_w,'shape',nil)
    return _w
 end
 
+local window = function(f,op,_w,_a,k)
+--- _a f/ _w: f/ of every window of length |_a| along _w, each window 
+-- reversed if _a<0. A matrix goes along axis k; the result is nil when 
+-- the core can't do it, and `along` takes over.
+   checktype(_a,'number',2,'Reduce')
+   argcheck(is_int(_a),2,"window size must be an integer",'Reduce')
+   local w = abs(_a)
+   local rows,cols = shape(_w)
+   local m = (k==1 and rows or k==2 and cols or #_w)-w+1
+   argcheck(m>=0,2,"window longer than ⍵",'Reduce')
+   if op=='mul' or w==0 then op=nil end
+   local res = op and core.window(op,_w,w,k)
+   if res or k then return res end
+   if w==0 then argcheck(unit[f],1,"function with no left-unit\n"..
+      help(f,0),'Reduce')
+   end
+   res=rho(0,m)
+   for i=1,m do
+      local acc
+      if w==0 then acc=unit[f]
+      elseif _a>0 then
+         acc=_w[i+w-1]
+         for j=i+w-2,i,-1 do acc=f(acc,_w[j]) end
+      else
+         acc=_w[i]
+         for j=i+1,i+w-1 do acc=f(acc,_w[j]) end
+      end
+      res[i]=acc
+   end
+   return res
+end
+
 Reduce = function(f)
    checktype(f,'function',1)
-   return function(_w)
+   local op=native[f]
+   if op~='add' and op~='mul' and op~='max' and op~='min' then op=nil end
+   return function(_w,_a,k)
+      if _a then return window(f,op,_w,_a,k) end
       local n=#_w
       if n==0 then 
          argcheck(unit[f],1,"function with no left-unit\n"..help(f,0),
             'Reduce')
          return unit[f] 
       end
-      local res=_w[n]
+      local res = op and reduce(op,_w)
+      if res then return res end
+      res=_w[n]
       for k=n-1,1,-1 do res=f(res,_w[k]) end
       return res
    end
@@ -975,10 +1472,9 @@ Reshape = function (_w,_a)
    local w1,w2=start(_w)
    local m,n=start(_a)
    if not m then return w1 end
+   if w2 then return core.reshape(_w,m,n) end
    local res=rho(w1,m,n)
-   if w2 then return set(res,1,#res,unpack(_w)) 
-      else return set(res,1,#res,w1)
-   end
+   return set(res,1,#res,w1)
 end
 
 Reverse = function(_w) 
@@ -1015,6 +1511,8 @@ Scan = function(f)
 end
 
 Set = function(_w,_a,v)
+   argcheck(not constant[_w],1,"attempt to modify a constant","Set")
+   version[_w] = (version[_w] or 0) + 1
    local v_tbl=is"table"(v)
    if is"function"(_a) then
       if v_tbl then
@@ -1065,8 +1563,119 @@ Up = function(_w)
 
 apl.register(0,Outer,'∘','Outer')
 
+-- Memoization. A result is cached under the identity of the arguments 
+-- and the number of times Set has modified each, so it is recomputed 
+-- after a modification. All memoized functions share one cache of at 
+-- most `apl._memo` bytes, from which the least recently used results 
+-- are evicted. The cache keeps its own copy of a result and hands out 
+-- copies, so that neither the caller nor the cache can modify what the
+-- other sees.
+local NOARG = {}                       -- cache key for a missing argument
+local weak_v = {__mode='v'}
+local memo = {bytes=0, entries=0, evictions=0, functions={}}
+local lru = {}                         -- circular list, most recent first
+lru.prev, lru.next = lru, lru
+
+local unlink = function(e) e.prev.next, e.next.prev = e.next, e.prev end
+local push = function(e) 
+   e.next, e.prev = lru.next, lru; lru.next.prev = e; lru.next = e 
+end
+
+local evict = function(limit)
+   while memo.bytes>limit and lru.prev~=lru do
+      local e = lru.prev
+      unlink(e); e.result = nil
+      local key, byw = e.key, e.byw    -- scalar keys are never collected
+      if key.a~=nil and byw[key.a]==e then byw[key.a]=nil end
+      if key.w~=nil and next(byw)==nil then e.cache[key.w]=nil end
+      memo.bytes, memo.entries = memo.bytes-e.bytes, memo.entries-1
+      memo.evictions = memo.evictions+1
+   end
+end
+
+local clone
+clone = function(v,seen)
+   if type(v)~='table' then return v end
+   if seen[v] then return seen[v] end
+   local c = {}
+   seen[v] = c
+   for k,x in next,v do c[k]=clone(x,seen) end
+   return setmetatable(c,getmetatable(v))
+end
+
+local clones = function(res)
+   local seen, c = {}, {n=res.n}
+   for k=1,res.n do c[k]=clone(res[k],seen) end
+   return c
+end
+
+local rate = function(t) 
+   local n = t.hits+t.misses
+   return n>0 and t.hits/n or 0
+end
+
+Memo = function(f,name)
+   if f==nil then
+      local stats = {bytes=memo.bytes, entries=memo.entries, 
+         evictions=memo.evictions, limit=apl._memo, hits=0, misses=0, 
+         functions={}}
+      for name,t in pairs(memo.functions) do
+         stats.functions[name] = {hits=t.hits, misses=t.misses, rate=rate(t)}
+         stats.hits, stats.misses = stats.hits+t.hits, stats.misses+t.misses
+      end
+      stats.rate = rate(stats)
+      return stats
+   elseif f=="clear" then evict(-1)
+      return
+   end
+   local target
+   if is"string"(f) then target, f = f, APL_ENV[f] end
+   checktype(f,'function',1,'Memo')
+   name = name or target or tostring(f)
+   local cache = setmetatable({},{__mode='k'})
+   local stats = {hits=0, misses=0}
+   memo.functions[name] = stats
+   local g = function(_w,_a)
+      local w, a = _w, _a
+      if w==nil then w=NOARG end
+      if a==nil then a=NOARG end
+      if w~=w or a~=a then return f(_w,_a) end  -- NaN can't be a key
+      local vw, va = version[w] or 0, version[a] or 0
+      local byw = cache[w]
+      local e = byw and byw[a]
+      if e and e.result and e.vw==vw and e.va==va then
+         stats.hits = stats.hits+1
+         unlink(e); push(e)
+         local res = clones(e.result)
+         return table.unpack(res,1,res.n)
+      end
+      stats.misses = stats.misses+1
+      local res = table.pack(f(_w,_a))
+      if e and e.result then 
+         unlink(e) 
+         memo.bytes, memo.entries = memo.bytes-e.bytes, memo.entries-1
+      end
+      if not byw then byw = setmetatable({},{__mode='k'}); cache[w] = byw end
+      e = {vw=vw, va=va, result=clones(res), cache=cache, byw=byw,
+         key=setmetatable({w=w,a=a},weak_v)}
+      e.bytes = core.sizeof(e.result)
+      byw[a] = e
+      push(e)
+      memo.bytes, memo.entries = memo.bytes+e.bytes, memo.entries+1
+      evict(apl._memo)
+      return table.unpack(res,1,res.n)
+   end
+   help(g,help(f,0))
+   if target then
+      if apl[target]==f then rawset(apl,target,g) end
+      APL_ENV[target] = g
+   end
+   return g
+end
+
 local lib={Rotate=Rotate, Expand=Expand, Compress=Compress, Scan=Scan,
-   Reduce=Reduce, Attach=Attach, Reverse=Reverse, Get=Get, Set=Set}
+   Reduce=Reduce, Attach=Attach, Reverse=Reverse, Get=Get, Set=Set,
+   Threads=core.threads, ReadCSV=core.readcsv, Memo=Memo}
 local f1={Copy=Copy, Disclose=Disclose, Down=Down, Enclose=Enclose, 
    MatInv=MatInv, Ravel=Ravel, Reverse1=Reverse, Reverse2=Reverse,
    Shape=Shape, Transpose=Transpose, Up=Up}
@@ -1074,7 +1683,8 @@ local f2={Attach1=Attach, Attach2=Attach, Compress1=Compress,
    Compress2=Compress, Deal=Deal, Decode=Decode, Drop=Drop, Encode=Encode, 
    Expand1=Expand, Expand2=Expand, Find=Find, Format=Format, Has=Has, 
    MatDiv=MatDiv, Reshape=Reshape, Rotate1=Rotate, Rotate2=Rotate, Take=Take}
-local op1={Each=Each,Reduce1=Reduce,Reduce2=Reduce,Scan1=Scan,Scan2=Scan}
+local op1={Each=Each,Key=Key,Reduce1=Reduce,Reduce2=Reduce,Scan1=Scan,
+   Scan2=Scan}
 local op2={Inner=Inner}
 
 replace(apl.lib,lib,apl.rank0.lib)
@@ -1088,6 +1698,23 @@ local helptext = {
 [Compress] = [[Compress(⍵,⍺): ⍺/⍵ → copies elements of ⍵ as counted by ⍺ ]];
 [Copy] = 'Copy: +⍵ returns a copy of the APL-visible part of ⍵';
 [Deal] = "Deal: ⍺?⍵ → ⍺ distinct numbers randomly selected from ⍳⍵";
+[core.threads] = [[
+Threads(n,threshold): use n threads for arithmetic, reductions, outer 
+   products and indexing on numeric arrays with at least `threshold` 
+   elements. Returns the current settings; both arguments are optional.]];
+[Memo] = [[
+Memo(f,name): function that caches the results of f by the identity of
+   its arguments, and returns copies of them until Set modifies an 
+   argument.
+   If f is the name of a registered function, that name now refers to 
+   the memoized function. The cache is limited to `apl._memo` bytes.
+Memo(): statistics on hits, misses, evictions and bytes, also by name.
+Memo"clear": empties the cache.]];
+[core.readcsv] = [[
+ReadCSV(filename,delim,skip): matrix of the numbers in a delimited text 
+   file, one row per line. delim defaults to ","; the first skip lines 
+   (default 0) and all blank lines are ignored. Empty or non-numeric 
+   fields give NaN. The file is read in fixed-size chunks.]];
 [Decode] = "Decode: ⍵⊤⍺ → Decompose ⍺ into base ⍵ digits";
 [Down] = "Down: ⍒⍵ → the permutation that grades ⍵ downwards";
 [Disclose] = [[
@@ -1112,13 +1739,20 @@ Enclose: ⊂⍵ makes an array of rows from a matrix or concatenates a vector.
 Find: ⍺⍳⍵ → position of first occurrence of ⍵ in ⍺; not found is #⍺+1]];
 [Get] = "Get: ⍵[⍺], see `help'Indexing'";
 [Has] = "Has: ⍺∊⍵ → does ⍺ occur in ⍵?";
+[Key] = [[
+Key(f): ⍺ f⌸ ⍵ → 2-row matrix of the distinct items of ⍺, in order of first 
+   occurrence, and f/ of the items of ⍵ in the same positions. A scalar ⍵
+   is used for every item, so ⍺ +⌸ 1 counts, and f⌸⍵ means ⍵ f⌸ 1.]];
 [MatDiv] = [[
 MatDiv: ⍺⌹⍵ → minimum-norm least-squares solution to the linear system with 
   matrix ⍵ and right-hand side ⍺. Depends on _act and _rct.]];
 [MatInv] = "MatInv: ⌹⍵ → Pseudo-inverse of ⍵. Depends on _act and _rct.";
 [Outer] = "Outer(g): ⍺ ∘.g ⍵ → ⍵[i] g ⍺[j] for all possible pairs"; 
 [Ravel] = "Ravel: ,⍵ → vector containing elements of ⍵";
-[Reduce] = [[Reduce(⍵,⍺): ⍺/⍵ → copies elements of ⍵ as counted by ⍺]];
+[Reduce] = [[
+Reduce(f): f/⍵ → ⍵[1] f ⍵[2] f ... f ⍵[n], evaluated right to left.
+   ⍺ f/⍵ → f/ of every window of ⍺ consecutive elements of ⍵, each 
+   window reversed if ⍺<0. Windowed +, ⌈ and ⌊ take O(n) time.]];
 [Reverse] = [[Reverse(⍵): ⌽⍵ → elements of ⍵ in reverse order]];
 [Reshape] = "Reshape: ⍺⍴⍵ → Make an array of shape ⍺ by using ⍵ cyclically";
 [Rotate] = 
@@ -1150,16 +1784,83 @@ local Copy,matinv,rawformat = f1.Copy,f1.MatInv,f1.ToString
 local Each = op1.Each
 local Disclose,   Enclose,   Transpose =
    f1.Disclose,f1.Enclose,f1.Transpose
-local Add,    Mul,    Div,    Reshape,    Same,    TestEq,  vecget,  vecset = 
-   f2.Add, f2.Mul, f2.Div, f2.Reshape, f2.Same, f2.TestEq, lib.Get, lib.Set
+local Add,    Mul,    Div,    Reshape,    Same,  vecget,  vecset = 
+   f2.Add, f2.Mul, f2.Div, f2.Reshape, f2.Same, lib.Get, lib.Set
 local Outer=apl.Outer
 
 local Attach,Attach1,Attach2, Compress1,Compress2, Expand1,Expand2, 
   Reduce1,Reduce2, Reverse1,Reverse2, Rotate,Rotate1,Rotate2, Scan1,Scan2
 local Decode, Drop, Encode, Format, Get, Inner, MatDiv, MatInv, Rerank, Set, 
    SVD, Take
+local Chol, Eig, QR, Solve
+local Shape, Sparse, Dense, Permute, ReduceAxis
+
+local concat,abs,max,min = table.concat,math.abs,math.max,math.min
+
+local strided = core.strided
+
+local dims = function(A)
+--- extents of A as a Lua list, for any rank
+   if is_not"table"(A) then return {} end
+   local s=rawget(A,'shape')
+   if s then return {unpack(s)} end
+   return {shape(A)}
+end
+
+local nd = function(A)
+--- true if A is an array of rank 3 or more
+   return is"table"(A) and rawget(A,'shape')~=nil
+end
+
+local selection = function(_w,_a,name)
+--- selections for core.strided from the APL indices _a, one per axis
+   local d=dims(_w)
+   argcheck(#_a==#d,2,"expected "..#d.." indices, got "..#_a,name)
+   local sel={}
+   for k=1,#d do
+      local i=rawget(_a,k)
+      if i==nil or i=='*' then i=iota(d[k]) end
+      sel[k]=i
+   end
+   return sel
+end
 
-local concat,max,min = table.concat,math.max,math.min
+local take_sel = function(n,a)
+--- positions of a↑ along an axis of extent n, 0 for fill
+   local res=rho(0,abs(a))
+   for i=1,abs(a) do
+      local p = a>=0 and i or n+a+i
+      if p>=1 and p<=n then res[i]=p end
+   end
+   return res
+end
+
+local reduce_axis = function(f,_w,k)
+--- f/[k]⍵ for an array of any rank: f folded over the slices along axis k
+   local d=dims(_w)
+   local n=d[k]
+   if n==0 then
+      argcheck(unit[f],1,"function with no left-unit\n"..help(f,0),'Reduce')
+      table.remove(d,k)
+      return Reshape(unit[f],d)
+   end
+   local sel={}
+   for j=1,#d do sel[j]=iota(d[j]) end
+   sel[k]=n
+   local res=strided(_w,sel)
+   for j=n-1,1,-1 do sel[k]=j; res=f(res,strided(_w,sel)) end
+   if #res==0 then      -- strided loses the shape of an empty selection
+      table.remove(d,k)
+      return Reshape(res,d)
+   end
+   return res
+end
+
+local issparse = core.issparse
+local sparse_arg = function(x)
+--- true if x is a sparse matrix made by Sparse
+   return type(x)=='userdata' and issparse(x)
+end
 
 local along=function(f,k,func)
 --- If f works on a vector, along(f,k) works on a matrix along axis k
@@ -1194,7 +1895,7 @@ local inner = function(f,_w,_a)
    if p then _a=Rerank(_a,-1) end
    if n then _w=Rerank(_w,-2) end
    if p then 
-      if n then return outer(f)(_w,_a)
+      if n then return Outer(f)(_w,_a)
       else 
          local res=rho(0,m)
          for k=1,m do res[k]=f(_w,_a[k]) end
@@ -1207,17 +1908,19 @@ local inner = function(f,_w,_a)
    end
 end
 
+local testeq=core.testeq
 local numrank=function(S)
    local s1,rank=S[1],0
+   local act,rct=apl._act,apl._rct
    for k,s in ipairs(S) do
-      if TestEq(s1,s1+s)==1 then break end
+      if testeq(s1,s1+s,act,rct)==1 then break end
       rank=rank+1
    end 
    return rank
 end
 
 Attach = function(_w,_a,axis)
-   if is_not"table"(_a) then _a=arr(_a) else _a=Copy(_a) end
+   if is_not"table"(_a) then _a=arr(_a) end
    if is_not"table"(_w) then _w=arr{_w} end
    local m1,n1=shape(_a)
    local m2,n2=shape(_w)
@@ -1228,6 +1931,9 @@ Attach = function(_w,_a,axis)
       elseif m2==0 then return Take(_a,max(1,m1 or 0),n)
       end
    end
+   local res = core.cat(_w,_a,axis,axis==2 and not n1 and filler(_a) or 0)
+   if res then return res end
+   _a=Copy(_a)
    if n1 then _a=Rerank(_a,-axis,'Attach') elseif axis==1 then _a=arr{_a} end
    if n2 then _w=Rerank(_w,-axis,'Attach') elseif axis==1 then _w=arr{_w} end
    local l,m=#_a,#_w
@@ -1236,11 +1942,24 @@ Attach = function(_w,_a,axis)
 end
 
 Decode = function(_w,_a)
+   local res = core.decode(_w,_a)
+   if res then return res end
+   argcheck(not (is_matrix(_w) or nd(_w) or is_matrix(_a)),2,
+      "needs numbers and a scalar or vector radix",'Decode')
    return both(decode,_w,_a,0,2)
 end
 
 Drop = function(_w,_a)
    if is_not"table"(_a) then return drop(_w,_a) end
+   if #_a>2 or nd(_w) then
+      local d,sel = dims(_w),{}
+      argcheck(#_a==#d,2,"expected "..#d.." counts, got "..#_a,'Drop')
+      for k=1,#d do 
+         local n,a = d[k],_a[k]
+         sel[k]=take_sel(n,a>=0 and -max(n-a,0) or max(n+a,0))
+      end
+      return strided(_w,sel)
+   end
    argcheck(#_a==2,2,"can't drop an array of rank "..#_a)
    local w=singleton(_w)
    if w then _w=rho(w,1,1) end
@@ -1248,7 +1967,7 @@ Drop = function(_w,_a)
    return along(drop,2)(along(drop,1)(_w,_a[1]),_a[2])
 end
 
-Encode = function(_w,_a) return inner(encode,_w,_a) end
+Encode = function(_w,_a) return core.encode(_w,_a) or inner(encode,_w,_a) end
 
 local function autoformat(x)
 --- compute ideal width for column
@@ -1259,6 +1978,12 @@ local function autoformat(x)
 end
 
 Format = function(_w,_a)
+   if nd(_w) then  -- the matrices along the first axis
+      local d,sel,res = dims(_w),{},{}
+      for k=2,#d do sel[k]=iota(d[k]) end
+      for i=1,d[1] do sel[1]=i; res[i]=Format(strided(_w,sel),_a) end
+      return concat(res,'\n\n')
+   end
    local m,n = shape(_w)
    if not n or #_w==0 then return vecformat(_w,_a) end
    _a = _a or apl._format 
@@ -1268,7 +1993,17 @@ Format = function(_w,_a)
 end   
 
 Get = function(_w,_a)
+   if sparse_arg(_w) then
+      checktype(_a,'table',2,'Get')
+      local i,j = rawget(_a,1), rawget(_a,2)
+      if i=='*' then i=nil end
+      if j=='*' then j=nil end
+      argcheck(is_not"table"(i) and is_not"table"(j),2,
+         "only scalar indices into a sparse matrix, use Dense",'Get')
+      return core.spget(_w,i,j)
+   end
    checktype(_w,'table',1)
+   if nd(_w) and is"table"(_a) then return strided(_w,selection(_w,_a,'Get')) end
    local rows,cols = shape(_w)
    if is_not"table"(_a) or not cols then return vecget(_w,_a) end
    -- indexing a matrix
@@ -1288,7 +2023,13 @@ Get = function(_w,_a)
 end
 
 Inner = function(f,g) 
+   local spmul = f==Add and g==Mul
    return function(_w,_a)
+      if sparse_arg(_w) or sparse_arg(_a) then
+         argcheck(spmul,1,"only +.× allowed on a sparse matrix, use Dense",
+            'Inner')
+         return core.spmul(_a,_w)
+      end
       return inner(function(x,y) return reduce(f)(g(x,y)) end,_w,_a)
    end
 end
@@ -1336,6 +2077,15 @@ end
  
 Set = function(_w,_a,v)
    checktype(_w,'table',1)
+   argcheck(not constant[_w],1,"attempt to modify a constant","Set")
+   version[_w] = (version[_w] or 0) + 1
+   if nd(_w) and is"table"(_a) then
+      local pos=iota(#_w)
+      rawset(pos,'shape',rawget(_w,'shape'))
+      pos=strided(pos,selection(_w,_a,'Set'))
+      if is"number"(pos) then pos={pos} end    -- all indices scalar
+      return vecset(_w,pos,v)
+   end
    local rows,cols = shape(_w)
    if is_not"table"(_a) or not cols then return vecset(_w,_a,v) end
    -- indexing a matrix   
@@ -1367,8 +2117,38 @@ SVD = function(_w)
    return {U=Enclose(Transpose(U)), S=S, V=Enclose(VT)}
 end
 
+-- The following decompositions return flat matrices
+
+Chol = function(A)
+   argcheck(is_matrix(A),1,"must be a matrix","Chol")
+   return core.chol(A)
+end
+
+Eig = function(A)
+   argcheck(is_matrix(A),1,"must be a matrix","Eig")
+   local L,V = core.eig(A)
+   return {L=L, V=V}
+end
+
+QR = function(A)
+   argcheck(is_matrix(A),1,"must be a matrix","QR")
+   local Q,R = core.qr(A)
+   return {Q=Q, R=R}
+end
+
+Solve = function(A,b)
+   argcheck(is_matrix(A),1,"must be a matrix","Solve")
+   return core.solve(A,b)
+end
+
 Take = function(_w,_a)
    if is_not"table"(_a) then return take(_w,_a) end
+   if #_a>2 or nd(_w) then
+      local d,sel = dims(_w),{}
+      argcheck(#_a==#d,2,"expected "..#d.." counts, got "..#_a,'Take')
+      for k=1,#d do sel[k]=take_sel(d[k],_a[k]) end
+      return strided(_w,sel,nil,filler(_w))
+   end
    argcheck(#_a==2,2,"can't take an array of rank "..#_a)
    local w=singleton(_w)
    if w then _w=rho(w,1,1) end
@@ -1378,12 +2158,38 @@ end
 
 Attach1 = function(_w,_a) return Attach(_w,_a,1) end;
 Attach2 = function(_w,_a) return Attach(_w,_a,2) end;
-Compress1 = along(compress,1,'Compress');
-Compress2 = along(compress,2,'Compress');
-Expand1 = along(expand,1,'Expand');
-Expand2 = along(expand,2,'Expand');
-Reduce1=function(f) return along(reduce(f),1,'Reduce') end;
-Reduce2=function(f) return along(reduce(f),2,'Reduce') end;
+local core_along = function(kernel,f,k,func)
+--- along(f,k), but done in the core unless the kernel declines
+   local g = along(f,k,func)
+   return function(_w,_a) 
+      local res = kernel(_w,_a,k)
+      if res then return res end
+      return g(_w,_a)
+   end
+end
+Compress1 = core_along(core.compress,compress,1,'Compress');
+Compress2 = core_along(core.compress,compress,2,'Compress');
+Expand1 = core_along(core.expand,expand,1,'Expand');
+Expand2 = core_along(core.expand,expand,2,'Expand');
+local reduce_along = function(f,k,g)
+--- g(_w,_a), but +/ and +⌿ of a sparse matrix, and windowed reductions 
+-- of a numeric matrix, are done in the core
+   local r=reduce(f)
+   return function(_w,_a)
+      if nd(_w) then
+         argcheck(not _a,2,"no windows on arrays of rank 3 or more",'Reduce')
+         return reduce_axis(f,_w,k==1 and 1 or #dims(_w))
+      end
+      if not sparse_arg(_w) then 
+         return _a and is_matrix(_w) and r(_w,_a,k) or g(_w,_a)
+      end
+      argcheck(f==Add,1,"only + allowed on a sparse matrix, use Dense",
+         'Reduce')
+      return core.spreduce(_w,k)
+   end
+end
+Reduce1=function(f) return reduce_along(f,1,along(reduce(f),1,'Reduce')) end;
+Reduce2=function(f) return reduce_along(f,2,along(reduce(f),2,'Reduce')) end;
 Reverse1 = along(reverse,1,'Reverse');
 Reverse2 = along(reverse,2,'Reverse');
 Rotate1 = function(_w,_a) return Rotate(_w,_a,1) end;
@@ -1391,13 +2197,84 @@ Rotate2 = function(_w,_a) return Rotate(_w,_a,2) end;
 Scan1=function(f) return along(scan(f),1,'Scan') end;
 Scan2=function(f) return along(scan(f),2,'Scan') end;
 
-local lib={Get=Get,Set=Set,Rerank=Rerank,SVD=SVD}
+local shape_of = f1.Shape
+Shape = function(_w)
+   if sparse_arg(_w) then return arr{_w.rows,_w.cols} end
+   if nd(_w) then return Copy(rawget(_w,'shape')) end
+   return shape_of(_w)
+end
+
+Permute = function(_w,_a)
+   local d=dims(_w)
+   _a=arr(_a)
+   argcheck(#_a==#d,2,"expected "..#d.." axes, got "..#_a,'Permute')
+   local perm,sel = {},{}
+   for k=1,#d do perm[_a[k]]=k end
+   for k=1,#d do
+      argcheck(perm[k],2,"not a permutation",'Permute')
+      sel[k]=iota(d[perm[k]])
+   end
+   return strided(_w,sel,perm)
+end
+
+local reshape = f2.Reshape
+Reshape = function(_w,_a)
+   if is_not"table"(_a) or #_a<3 then return reshape(_w,_a) end
+   local n=1
+   for k=1,#_a do n=n*_a[k] end
+   local res=reshape(_w,n)
+   rawset(res,'shape',Copy(_a))
+   return res
+end
+
+ReduceAxis = function(f,k)
+   checktype(f,'function',1,'ReduceAxis')
+   checktype(k,'number',2,'ReduceAxis')
+   return function(_w) 
+      argcheck(k>=1 and k<=#dims(_w),2,"no such axis",'ReduceAxis')
+      return reduce_axis(f,_w,k) 
+   end
+end
+
+Sparse = function(_w,_a)
+   checktype(_w,'table',1,'Sparse')
+   argcheck(is_matrix(_w),1,"not a matrix",'Sparse')
+   return core.sparse(_w,_a or 1)
+end
+
+Dense = function(_w)
+   if not sparse_arg(_w) then return _w end
+   return core.dense(_w)
+end
+
+local sparse_meta = getmetatable(core.sparse(rho(0,1,1)))
+local sparse_index = sparse_meta.__index
+sparse_meta.__tostring = function(S) return tostring(core.dense(S)) end
+sparse_meta.__index = function(S,k)   -- S[i;j] compiles to S[{i,j}]
+   if is"table"(k) then return Get(S,k) end
+   return sparse_index(S,k)
+end
+
+local transpose = f1.Transpose
+Transpose = function(_w)
+   if sparse_arg(_w) then return core.sptranspose(_w) end
+   if nd(_w) then   -- reverse the order of the axes
+      local r,perm = #dims(_w),{}
+      for k=1,r do perm[k]=r+1-k end
+      return Permute(_w,perm)
+   end
+   return transpose(_w)
+end
+
+local lib={Get=Get,Set=Set,Rerank=Rerank,SVD=SVD,Chol=Chol,Eig=Eig,QR=QR,
+   Solve=Solve,Sparse=Sparse,Dense=Dense,ReduceAxis=ReduceAxis}
 local f1={Down=Down, MatInv=MatInv, Ravel=Ravel, Reverse1=Reverse1, 
-   Reverse2=Reverse2}
+   Reverse2=Reverse2, Shape=Shape, Transpose=Transpose}
 local f2={Attach1=Attach1, Attach2=Attach2, Compress1=Compress1, 
    Compress2=Compress2, Decode=Decode, Drop=Drop, Encode=Encode, 
    Expand1=Expand1, Expand2=Expand2, Format=Format, MatDiv=MatDiv, 
-   Reshape=Reshape, Rotate1=Rotate1, Rotate2=Rotate2, Take=Take}
+   Permute=Permute, Reshape=Reshape, Rotate1=Rotate1, Rotate2=Rotate2, 
+   Take=Take}
 local op1={Reduce1=Reduce1,Reduce2=Reduce2,Scan1=Scan1,Scan2=Scan2}
 local op2={Inner=Inner}
 
@@ -1410,7 +2287,7 @@ replace(apl.op1,op1,apl.rank1.op1)
 replace(apl.op2,op2,apl.rank1.op2)
 
 for class,group in pairs(apl.rank1) do -- copy over help for new function
-   for k,v in pairs(group) do help(apl[class][k],help(v,0)) end
+   for k,v in pairs(group) do help_from(apl[class][k],v) end
 end
 
 local helptext = {
@@ -1422,8 +2299,9 @@ local helptext = {
 [Expand2] = "Expand2(⍵,⍺): ⍺\\⍵ → inserts neutral columns ⍵ as counted by ⍺";
 [Format] = "Format: ⍺⍕⍵ → format ⍵ according to ⍺, see User's Manual";
 [Inner] = "Inner(f,g): f.g → a dyadic function returning f/⍺ g ⍵.";
-[Reduce1] = "Reduce1(⍵,⍺): ⍺⌿⍵ → copies rows of ⍵ as counted by ⍺";
-[Reduce2] = "Reduce2(⍵,⍺): ⍺/⍵ → copies columns of ⍵ as counted by ⍺";
+[Reduce1] = "Reduce1(f): f⌿⍵ → reduce over rows; ⍺ f⌿⍵ → windows of ⍺ rows";
+[Reduce2] = 
+   "Reduce2(f): f/⍵ → reduce over columns; ⍺ f/⍵ → windows of ⍺ columns";
 [Reverse1] = "Reverse1(⍵): ⊖⍵ → rows of ⍵ in reverse order";
 [Reverse2] = "Reverse2(⍵): ⌽⍵ → columns of ⍵ in reverse order";
 [Rotate1] = 
@@ -1443,9 +2321,159 @@ SVD(A): A table with three entries containing the SVD of an m×n matrix A.
   S: min(m,n) singular values of A. 
   U: nested array of left singular vectors.
   V: nested array of right singular vectors.]])
+help(Chol, [[
+Chol(A): upper triangular R such that A = R'R, for a symmetric positive 
+  definite matrix A.]])
+help(Eig, [[
+Eig(A): A table with two entries containing the eigensystem of a 
+  symmetric matrix A. Only the upper triangle of A is used.
+  L: eigenvalues of A in ascending order.
+  V: matrix whose columns are the corresponding eigenvectors.]])
+help(QR, [[
+QR(A): A table with two entries containing the QR factorization of an 
+  m×n matrix A, with k=min(m,n).
+  Q: m×k matrix with orthonormal columns.
+  R: k×n upper triangular matrix.]])
+help(Solve, [[
+Solve(A,b): x such that A x = b, for a square matrix A and a vector or 
+  matrix b, by LU factorization with partial pivoting.]])
+help(Permute, [[
+Permute(⍵,⍺): ⍺⍉⍵ → axis k of ⍵ becomes axis ⍺[k] of the result. Monadic
+  ⍉ reverses the order of the axes.]])
+help(ReduceAxis, [[
+ReduceAxis(f,k): (Lua mode only) function that reduces an array of any 
+  rank along axis k. For arrays of rank 3 or more, f/ reduces along the 
+  last axis and f⌿ along the first.]])
+help(Sparse, [[
+Sparse(A,d): sparse copy of the matrix A, or nil if more than a fraction 
+  d (default 1) of the entries of A are nonzero. Sparse matrices support 
+  ⍴, ⍉, +/, +⌿, +.×, ∧ and indexing by scalars; use Dense for the rest.
+  See also help"_sparse".]])
+help(Dense, [[
+Dense(S): ordinary matrix with the same entries as the sparse matrix S.
+  Anything else is returned unchanged.]])
 
           end -- matrix functions
 
+          if _APL_LEVEL>0 then --## texts, sparse matrices, rank 3 or more
+
+-- A text is a character vector kept in one block by the core. The 
+-- functions in `text` handle texts natively and return nothing when they
+-- can't. Every other non-scalar function sees a text as an ordinary 
+-- array of characters, refuses a sparse matrix unless listed in 
+-- `sparse_ok`, and refuses an array of rank 3 or more unless listed in
+-- `nd_ok` (`'w'` if only ⍵ may have that rank).
+
+local istext, textsub, textfind = core.istext, core.textsub, core.textfind
+local text = {}
+
+text.Enclose = function(_w) if istext(_w) then return tostring(_w) end end
+text.Shape = function(_w) if istext(_w) then return arr{#_w} end end
+text.Find = function(_w,_a) if istext(_a) then return textfind(_a,_w) end end
+text.Has = function(_w,_a) 
+   if istext(_w) then return textfind(_w,_a,true) end 
+end
+text.Take = function(_w,_a)
+   if istext(_w) and is_int(_a) and math.abs(_a)<=#_w then
+      if _a<0 then return textsub(_w,_a) else return textsub(_w,1,_a) end
+   end
+end
+text.Drop = function(_w,_a)
+   if istext(_w) and is_int(_a) then
+      if _a<0 then return textsub(_w,1,#_w+_a) end
+      return textsub(_w,_a+1)
+   end
+end
+text.Get = function(_w,_a)
+   if istext(_w) and is_int(_a) and _a>=1 and _a<=#_w then return _w[_a] end
+end
+
+local sparse_ok = {Get=true, Inner=true, Reduce1=true, Reduce2=true, 
+   Shape=true, Transpose=true}
+local nd_ok = {Copy=true, Decode=true, Each=true, Encode=true, 
+   Format=true, Get=true, Ravel=true, Reduce1=true, Reduce2=true, 
+   Shape=true, ToString=true, Transpose=true, 
+   Drop='w', Find='w', Has='w', Permute='w', Reshape='w', Take='w'}
+local any_value = {Pass=true, Same=true}  -- not guarded at all
+
+local nd = function(x) return type(x)=='table' and rawget(x,'shape')~=nil end
+local rank_check = function(_w,_a,k,ok)
+   if ok~=true and (nd(_a) or not ok and nd(_w)) then 
+      error(k..": rank 3 or more not supported",2)
+   end
+end
+
+local guard = function(f,k)
+   local t, keep, ok = text[k], sparse_ok[k], nd_ok[k]
+   local g = function(_w,_a)
+      if type(_w)=='userdata' or type(_a)=='userdata' then
+         local res = t and t(_w,_a)
+         if res~=nil then return res end
+         _w, _a = plain(_w,k,keep), plain(_a,k,keep)
+      end
+      rank_check(_w,_a,k,ok)
+      return f(_w,_a)
+   end
+   help_from(g,f)
+   return g
+end
+
+local guarded = {}   -- a function that is both monadic and dyadic once
+for _,class in ipairs{'f1','f2'} do
+   for k,f in pairs(apl[class]) do 
+      if not (apl.rank0[class][k] or any_value[k]) then
+         guarded[f] = guarded[f] or guard(f,k)
+         apl[class][k] = guarded[f]
+      end
+   end
+end
+local Get = guard(apl.lib.Get,'Get')
+apl.lib.Get = Get
+for _,k in ipairs{'Attach','Compress','Expand','Reverse','Rotate'} do
+   apl.lib[k] = guard(apl.lib[k],k)
+end
+
+for _,class in ipairs{'op1','op2'} do   -- guard the derived functions
+   for k,op in pairs(apl[class]) do
+      local keep, ok = sparse_ok[k], nd_ok[k]
+      apl[class][k] = function(f,g)
+         local h = op(f,g)
+         return function(_w,_a)
+            if type(_w)=='userdata' or type(_a)=='userdata' then
+               _w, _a = plain(_w,k,keep), plain(_a,k,keep)
+            end
+            rank_check(_w,_a,k,ok)
+            return h(_w,_a)
+         end
+      end
+      help_from(apl[class][k],op)
+   end
+end
+
+-- T[i] is an item of T, T[{...}] compiled from APL indexes T as an array
+local text_meta = getmetatable(core.text"")
+local text_index = text_meta.__index
+text_meta.__index = function(T,k)
+   if is"table"(k) then return Get(plain(T),k) end
+   return text_index(T,k)
+end
+
+local Text = function(_w)
+   if is"table"(_w) then _w=table.concat(_w) end
+   return core.text(_w)
+end
+apl.lib.Text = Text
+
+help(Text, [[
+Text(s): the string s, or the concatenation of the strings in a vector s,
+   as a text: a character vector kept in one block, whose length, items 
+   and slices ↑ and ↓ take constant time. = ≠ ⍳ ∊ ⍴ and ⊂ work on texts 
+   directly; other functions see an ordinary array of characters. 
+   tostring(t) is the string again. With apl._split=apl.Text, ⊃ of a 
+   string gives a text.]])
+
+          end -- texts, sparse matrices, rank 3 or more
+
           do  --## Build the compiler tables from the dictionary
 
 local f1 = {Abs='∣', Ceil='⌈', Disclose='⊃', Enclose='⊂', Exp='⋆', Define='∇',
@@ -1459,10 +2487,10 @@ local f2={Add='+', And='∧', Binom='!', Circ='○', Div='÷', Log='⍟', Max='
   TestEq='=', TestGE='≥', TestGT='>', TestLE='≤', TestLT='<', TestNE='≠', 
   Attach1='⍪', Attach2=',', Compress1='⌿', Compress2='/', Deal='?', 
   Decode='⊤', Drop='↓', Encode='⊥', Expand1='⍀', Expand2='\\', Find='⍳', 
-  Format='⍕', Has='∊', MatDiv='⌹', Pass='∘', Reshape='⍴', Rotate1='⊖', 
+  Format='⍕', Has='∊', MatDiv='⌹', Pass='∘', Permute='⍉', Reshape='⍴', Rotate1='⊖', 
   Rotate2='⌽', Same='≡', Take='↑'}  
 
-local op1={Each='¨',Reduce1='⌿',  Reduce2='/', Scan1='⍀', Scan2='\\'}
+local op1={Each='¨',Key='⌸',Reduce1='⌿',  Reduce2='/', Scan1='⍀', Scan2='\\'}
 
 local op2={Inner='.'}
 
@@ -1473,6 +2501,9 @@ local alias={['∼']='~',['∧']='^',['⋆']='*',['−']='-',['∣']='|'}
 
 local function build(mapping,funcs,class)
    if not mapping then return end
+   if _APL_FAST then 
+      return apl.register_table(class,mapping,funcs,alias) 
+   end
    for LuaName,APLname in pairs(mapping) do 
       apl.register(class,funcs[LuaName],APLname,LuaName,alias[APLname])      
    end
@@ -1482,12 +2513,20 @@ build(lua_dict.f2,apl.f2,2);
 build(lua_dict.op1,apl.op1,5); 
 build(lua_dict.op2,apl.op2,6);
 
-for k,v in pairs(apl.lib) do apl.register(0,v,'',k) end
+if _APL_FAST then 
+   local reserved={}
+   for k in pairs(apl.lib) do reserved[k]='' end
+   apl.register_table(0,reserved,apl.lib)
+else for k,v in pairs(apl.lib) do apl.register(0,v,'',k) end
+end
 
 -- Functions 
 
 unit = {[apl.Add]=0, [apl.Mul]=1, [apl.And]=1, [apl.Or]=0,
   [apl.Min]=math.huge, [apl.Max]=-math.huge}
+scalar_fn = {}
+for k in pairs(apl.rank0.f1) do scalar_fn[k]=true end
+for k in pairs(apl.rank0.f2) do scalar_fn[k]=k~='Deal' end
  
           end -- Build the compiler tables from the dictionary
 
@@ -1510,6 +2549,8 @@ arr_meta.__newindex = apl.lib.Set
 
 apl._act=2^-48
 apl._rct=apl._act
+apl._fold=true
+apl._memo=2^26
 
 help("APL",help(apl_dict,0))
 help("NaN",[[
@@ -1525,8 +2566,12 @@ Circle functions. Assuming that arguments are in range:
 help("_act","_act: absolute comparison tolerance, default 2^-48")
 help("_rct","_rct: relative comparison tolerance, default 2^-48")
 help("_join","_join: vector join function, default string.concat")
-help("_split","_split: string splitter, default apl.util.utfchar")
+help("_split",
+   "_split: string splitter, default apl.util.utfchar; apl.Text gives texts")
 help("_format","_format: default format, 'raw' means no prettyprinting")
+help("_cache",[[
+_cache: directory for compiled APL code, default nil (no caching). Code
+   found there is loaded as bytecode instead of being compiled again.]])
 help("start",[[
     help(apl)         -- displays keys in table `apl`
     help"APL"         -- displays information on topic "APL"
@@ -1535,17 +2580,39 @@ help("start",[[
     apl:import'Func'  -- imports `Func` (comma-separated) into _ENV 
     apl:import"*"     -- imports all names not starting with `_` into _ENV]])
 
+help("_memory",[[
+_memory: soft limit in bytes on memory in use, default nil (none). New 
+   arrays that would exceed it raise an error instead. See Memory.]])
+help("_progress",[[
+_progress: function called as f(done,total) between slices of 65536 
+   items by Each, and by scalar functions that apply Lua code item by 
+   item, default nil. It may yield, e.g. `apl._progress=coroutine.yield`.
+   The numeric kernels do not call it.]])
+help("_memo",[[
+_memo: bytes of results kept by memoized functions, default 2^26. See 
+   Memo.]])
+help("_fold",[[
+_fold: hoist literal vectors out of compiled code and evaluate pure 
+   primitives on constants at compile time, default true. See Constant.]])
+help("_sparse",[[
+_sparse: density below which comparisons and ∧ return sparse matrices, 
+   default nil (never). See Sparse.]])
+help("_startup","_startup: CPU time in seconds taken to load the module")
+
+if not _APL_FAST then
 print (([[
 %s (Lua code) © Dirk Laurie 2013
 Bug reports are welcome. You'll find me on Lua-L.
 If you can't remember the README, do this:
   help'start']]):format(_VERSION))
 print("In Lua mode, you will need `apl:import()` first.\n--")
+end
 
           if _APL_LEVEL<3 then -- remove links to internal tables
-apl.APL_ENV, apl.f1, apl.f2, apl.op1, apl.op2, apl.rank0, apl.rank1, apl.lib 
-   = nil
+apl.APL_ENV, apl.f1, apl.f2, apl.op1, apl.op2, apl.rank0, apl.rank1, apl.lib,
+   apl.register_table = nil
           end
 
+apl._startup = os.clock()-startup
 loading=false
 return apl
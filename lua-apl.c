@@ -93,11 +93,18 @@ static lua_State *globalL = NULL;
 
 static const char *progname = LUA_PROGNAME;
 
+static const char *server_path = NULL;  /* socket for server mode */
+
+
+
+/* interrupt flag of apl_core, polled between slices of long C loops */
+static volatile sig_atomic_t *apl_interrupt = NULL;
 
 
 static void lstop (lua_State *L, lua_Debug *ar) {
   (void)ar;  /* unused arg. */
   lua_sethook(L, NULL, 0, 0);
+  if (apl_interrupt) *apl_interrupt = 0;
   luaL_error(L, "interrupted!");
 }
 
@@ -105,6 +112,7 @@ static void lstop (lua_State *L, lua_Debug *ar) {
 static void laction (int i) {
   signal(i, SIG_DFL); /* if another SIGINT happens before lstop,
                               terminate process (default action) */
+  if (apl_interrupt) *apl_interrupt = 1;
   lua_sethook(globalL, lstop, LUA_MASKCALL | LUA_MASKRET | LUA_MASKCOUNT, 1);
 }
 
@@ -179,6 +187,10 @@ static int docall (lua_State *L, int narg, int nres) {
   lua_pushcfunction(L, traceback);  /* push traceback function */
   lua_insert(L, base);  /* put it under chunk and args */
   globalL = L;  /* to be available to 'laction' */
+  lua_getfield(L, LUA_REGISTRYINDEX, "apl_interrupt");
+  apl_interrupt = (volatile sig_atomic_t *)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  if (apl_interrupt) *apl_interrupt = 0;
   signal(SIGINT, laction);
   status = lua_pcall(L, narg, nres, base);
   signal(SIGINT, SIG_DFL);
@@ -356,6 +368,235 @@ static void dotty (lua_State *L) {
 }
 
 
+/*
+** Server mode: `lua-apl -s path` listens on a Unix domain socket and
+** evaluates chunks sent by clients, one at a time, in a single workspace.
+** Request: 1 byte kind, 4 bytes length (big-endian), chunk.
+**   Kind 'A' means APL code and 'L' means Lua code. Lowercase 'a' or 'l'
+**   asks for a binary instead of a formatted result.
+**   A chunk longer than LUA_APL_MAXREQUEST bytes is refused with an
+**   error reply, and the connection is closed.
+** Reply: 1 byte status ('R' result, 'E' error), 4 bytes length, payload.
+**   A formatted reply contains `tostring` of each result, one per line.
+**   A binary reply needs a single number or numeric array as result,
+**   and contains int32 rank, int32 dimensions (the `shape` field of an
+**   array of rank 3 or more), and doubles, all in native byte order.
+*/
+#if defined(LUA_USE_POSIX)
+
+#include <ctype.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* longest chunk accepted; a longer request gets an error reply and the
+   connection is closed */
+#if !defined(LUA_APL_MAXREQUEST)
+#define LUA_APL_MAXREQUEST	(64*1024*1024)
+#endif
+
+static int readfull (int fd, char *b, size_t n) {
+  while (n > 0) {
+    ssize_t k = read(fd, b, n);
+    if (k < 0 && errno == EINTR) continue;
+    if (k <= 0) return 0;
+    b += k; n -= k;
+  }
+  return 1;
+}
+
+
+static int writefull (int fd, const char *b, size_t n) {
+  while (n > 0) {
+    ssize_t k = write(fd, b, n);
+    if (k < 0 && errno == EINTR) continue;
+    if (k <= 0) return 0;
+    b += k; n -= k;
+  }
+  return 1;
+}
+
+
+static int reply (int fd, int status, const char *b, size_t l) {
+  unsigned char h[5];
+  h[0] = status;
+  h[1] = (l >> 24) & 0xFF; h[2] = (l >> 16) & 0xFF; 
+  h[3] = (l >> 8) & 0xFF; h[4] = l & 0xFF;
+  return writefull(fd, (char *)h, 5) && writefull(fd, b, l);
+}
+
+
+/* format_results(...) returns all its arguments `tostring`ed, one per line */
+static int format_results (lua_State *L) {
+  int i, n = lua_gettop(L);
+  luaL_Buffer B;
+  luaL_buffinit(L, &B);
+  for (i = 1; i <= n; i++) {
+    luaL_tolstring(L, i, NULL);
+    luaL_addvalue(&B);
+    if (i < n) luaL_addchar(&B, '\n');
+  }
+  luaL_pushresult(&B);
+  return 1;
+}
+
+
+#if !defined(LUA_APL_MAXRANK)
+#define LUA_APL_MAXRANK 32
+#endif
+
+/* pack_results(x) returns number or numeric array `x` in binary form */
+static int pack_results (lua_State *L) {
+  int i, n = 1, head[LUA_APL_MAXRANK+1] = {0};
+  lua_Number x;
+  luaL_Buffer B;
+  luaL_argcheck(L, lua_gettop(L) == 1, 1, "binary reply needs one result");
+  if (lua_type(L, 1) != LUA_TNUMBER) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    n = head[1] = luaL_len(L, 1);
+    head[0] = 1;
+    lua_getfield(L, 1, "shape");  /* metamethod `__index` returns raw field */
+    if (lua_istable(L, -1)) {
+      head[0] = luaL_len(L, -1);
+      luaL_argcheck(L, head[0] <= LUA_APL_MAXRANK, 1, "rank too high");
+      for (i = 1; i <= head[0]; i++) {
+        lua_rawgeti(L, -1, i);
+        head[i] = lua_tointeger(L, -1);
+        lua_pop(L, 1);
+      }
+    }
+    lua_pop(L, 1);
+    lua_getfield(L, 1, "cols");
+    if (head[0] == 1 && !lua_isnil(L, -1)) {
+      head[0] = 2;
+      head[2] = lua_tointeger(L, -1);
+      head[1] = head[2] ? n/head[2] : 0;
+    }
+    lua_pop(L, 1);
+  }
+  luaL_buffinit(L, &B);
+  luaL_addlstring(&B, (char *)head, (head[0]+1)*sizeof(int));
+  for (i = 1; i <= n; i++) {
+    if (head[0] == 0) x = lua_tonumber(L, 1);
+    else {
+      lua_rawgeti(L, 1, i);
+      if (lua_type(L, -1) != LUA_TNUMBER)
+        return luaL_error(L, "binary reply needs numbers, item %d is %s",
+           i, luaL_typename(L, -1));
+      x = lua_tonumber(L, -1);
+      lua_pop(L, 1);
+    }
+    luaL_addlstring(&B, (char *)&x, sizeof(x));
+  }
+  luaL_pushresult(&B);
+  return 1;
+}
+
+
+/* evaluate one chunk; leaves results or error message on the stack */
+static int serve_chunk (lua_State *L, int kind, const char *b, size_t l) {
+  int status;
+  lua_settop(L, 0);
+  if (kind == 'A') {
+    lua_getglobal(L, "apl");
+    lua_pushlstring(L, b, l);
+    status = docall(L, 1, 1);  /* compile */
+  }
+  else if (kind == 'L')
+    status = luaL_loadbuffer(L, b, l, "=client");
+  else {
+    lua_pushfstring(L, "unknown request kind '%c'", kind);
+    return LUA_ERRRUN;
+  }
+  if (status == LUA_OK) status = docall(L, 0, LUA_MULTRET);
+  return status;
+}
+
+
+static void serve (lua_State *L, int fd) {
+  unsigned char h[5];
+  char *b;
+  const char *msg;
+  size_t l;
+  int status;
+  while (readfull(fd, (char *)h, 5)) {
+    l = ((size_t)h[1] << 24) | (h[2] << 16) | (h[3] << 8) | h[4];
+    if (l > LUA_APL_MAXREQUEST) {
+      msg = "request too long";
+      reply(fd, 'E', msg, strlen(msg));
+      break;
+    }
+    if ((b = (char *)malloc(l + 1)) == NULL) break;
+    if (!readfull(fd, b, l)) { free(b); break; }
+    status = serve_chunk(L, toupper(h[0]), b, l);
+    free(b);
+    if (status == LUA_OK) {
+      lua_pushcfunction(L, islower(h[0]) ? pack_results : format_results);
+      lua_insert(L, 1);
+      status = lua_pcall(L, lua_gettop(L) - 1, 1, 0);
+    }
+    msg = lua_tolstring(L, -1, &l);
+    if (msg == NULL) {
+      msg = "(error object is not a string)";
+      l = strlen(msg);
+    }
+    if (!reply(fd, status == LUA_OK ? 'R' : 'E', msg, l)) break;
+    lua_settop(L, 0);
+    lua_gc(L, LUA_GCSTEP, 0);
+  }
+}
+
+
+static int doserver (lua_State *L) {
+  struct sockaddr_un addr;
+  struct stat st;
+  int sock, fd;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(server_path) >= sizeof(addr.sun_path)) {
+    l_message(progname, "socket path too long");
+    return 0;
+  }
+  strcpy(addr.sun_path, server_path);
+  if (lstat(server_path, &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {  /* never remove anything but a socket */
+      l_message(progname, lua_pushfstring(L, "%s: exists and is not a socket",
+        server_path));
+      return 0;
+    }
+    unlink(server_path);  /* stale socket from an earlier run */
+  }
+  sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0
+      || listen(sock, 8) < 0) {
+    l_message(progname, lua_pushfstring(L, "%s: %s", server_path,
+      strerror(errno)));
+    return 0;
+  }
+  signal(SIGPIPE, SIG_IGN);  /* a vanished client must not kill us */
+  while ((fd = accept(sock, NULL, NULL)) >= 0 || errno == EINTR) {
+    if (fd < 0) continue;
+    serve(L, fd);
+    close(fd);
+  }
+  close(sock);
+  unlink(server_path);
+  return 1;
+}
+
+#else
+
+static int doserver (lua_State *L) {
+  (void)L;
+  l_message(progname, "server mode needs a POSIX system");
+  return 0;
+}
+
+#endif
+
+
 static int handle_script (lua_State *L, char **argv, int n) {
   int status;
   const char *fname;
@@ -496,7 +737,10 @@ static int pmain (lua_State *L) {
   if (!runargs(L, argv, (script > 0) ? script : argc)) return 0;
   /* execute main script (if there is one) */
   if (script && handle_script(L, argv, script) != LUA_OK) return 0;
-  if (args[has_i])  /* -i option? */
+  if (server_path) {  /* lua-apl -s path */
+    if (!doserver(L)) return 0;
+  }
+  else if (args[has_i])  /* -i option? */
     dotty(L);
   else if (script == 0 && !args[has_e] && !args[has_v]) {  /* no arguments? */
     if (lua_stdin_is_tty()) {
@@ -509,14 +753,21 @@ static int pmain (lua_State *L) {
   return 1;
 }
 
+/* If the environment variable LUA_APL_FAST is set, module `apl` is
+   loaded in fast mode (see `_APL_FAST` in apl.lua) and the time it took
+   is reported instead of its banner. 
+   `lua-apl -s path` runs a server instead of the interactive loop. */
 int main (int argc, char **argv) {
   int status, result, k;
-  char *myarg[argc+5], *arg[]={
-    "-l","apl",
-    "-e","apl:import()",
-    "-i"};
+  char **init, *myarg[argc+10], 
+    *normal[]={ "-l","apl", "-e","apl:import()", "-i", NULL},
+    *fast[]={ "-e","_APL_FAST=true", "-l","apl", 
+      "-e","print(('Lua⋆APL loaded in %.3fs'):format(apl._startup))",
+      "-e","apl:import()", "-i", NULL};
+  if (argc==3 && strcmp(argv[1],"-s")==0) { server_path=argv[2]; argc=1; }
   if (argc>1) {
-    printf("Error: lua-apl does not accept extra command-line arguments\n");
+    printf("Error: lua-apl accepts no command-line arguments except "
+      "'-s socket'\n");
     return EXIT_FAILURE;
   }
   lua_State *L = luaL_newstate();  /* create state */
@@ -525,9 +776,11 @@ int main (int argc, char **argv) {
     return EXIT_FAILURE;
   }
   /* add arguments to load and initialize module `apl` */
+  init = getenv("LUA_APL_FAST") ? fast : normal;
   myarg[0]=strdup(argv[0]);
-  for (k=0; k<5; k++) myarg[k+1]=strdup(arg[k]);
-  argc+=5; 
+  for (k=0; init[k]; k++) myarg[k+1]=strdup(init[k]);
+  myarg[k+1]=NULL;
+  argc+=k; 
   /* call 'pmain' in protected mode */
   lua_pushcfunction(L, &pmain);
   lua_pushinteger(L, argc);  /* 1st argument */
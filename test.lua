@@ -72,6 +72,7 @@ tests[2] = [[
 2 3⍴¨5 4
 j←⍒A←?10⍴100
 A[j]
+(10|(⍳3)∘.+⍳10)+.×j
 A,0↑A[5]←-5
 n←(0,⍳10)!10
 f←n⍪?n
@@ -91,6 +92,19 @@ f←n⍪?n
 'raw'⍕10|(⍳9)∘.+⍳9
 '%d'⍕10⊥10|(⍳9)∘.+⍳9
 10 10⊤10|(⍳9)∘.+⍳9
+24 60 60⊤3661 7322 86399
+24 60 60⊥24 60 60⊤3661 7322 86399
+⍴10 10⊤2 3⍴⍳6
+10 10⊥10 10⊤2 3⍴17 23 45 99 0 1
+3 1 3 2 1 +⌸ 1 2 3 4 5
++⌸3 1 3 2 1
+3 ⌈/ 5 1 4 2 8 3
+2 +/1e16 1 1 1
+2 +/1,(÷0),1 1 1
+2 −⌿3 4⍴⍳12
++/2 3 4⍴⍳24
+1 2 ¯2↑2 1 3⍉2 3 4⍴⍳24
+1 2⌿1 0 1 1 1\(2 3⍴⍳6),7 8
 10|(⍳9)∘.×⍳9
 10|(⍳9)∘.-⍳9
 10|(⍳9)∘.<⍳9
@@ -111,7 +125,128 @@ f←n⍪?n
 (⍳4)⌹⍉3 4⍴⍳12
 ]]
 
-aplchars = [[! + , . / < = > ? \ § ¨ × ÷ ↑ ↓ ∇ ∊ − ∘ ∣ ∧ ∨ ∼ ≠ ≡ ≤ ≥ ⊂ ⊃ ⊖ ⊤ ⊥ ⋆ ⌈ ⌊ ⌹ ⌽ ⌿ ⍀ ⍉ ⍋ ⍎ ⍒ ⍕ ⍟ ⍪ ⍱ ⍲ ⍳ ⍴ ⎕ ○]]
+-- Lua⋆APL features that have no APL symbol are checked from Lua
+local luatests = {}
+
+luatests[2] = [[
+cache=os.tmpname(); os.remove(cache); os.execute("mkdir "..cache); apl._cache=cache
+apl"+/⍳4"()
+os.remove(cache)==nil
+apl"+/⍳4"()
+apl._cache=nil; os.execute("rm -r "..cache)
+apl.Seed(42); r=apl"?5⍴100"()
+apl.Seed(42)
+apl"(?5⍴100)=r"()
+apl.Seed(42,2)
+apl"(?5⍴100)=r"()
+apl"+/10?10"()
+apl"((⍳10)∊?1000⍴10)"()
+apl"(1 2 3+1e¯15)=1 2 3"()
+apl"(1 2 3+1e¯15)≤1 2 3"()
+apl._act=0; apl._rct=0
+apl"(1 2 3+1e¯15)=1 2 3"()
+apl"(1 2 3+1e¯15)≤1 2 3"()
+apl._act=2^-48; apl._rct=apl._act
+nt,th=apl.Threads(); apl.Threads(4,1000)
+apl"+/(⍳300000)×2"()
+apl"(⌈/⍳300000),⌊/1+⍳300000"()
+apl.Threads(nt,th)
+A=apl"3 2⍴1 2 3 4 5 7"(); F=apl.QR(A); Q,R=F.Q,F.R
+apl"⌊0.5+1e6×Q+.×R"()
+apl"⌊0.5+1e6×(⍉Q)+.×Q"()
+S=apl"3 3⍴4 1 0 1 3 1 0 1 2"(); E=apl.Eig(S); V,L=E.V,E.L
+apl"|⌊0.5+1e6×(S+.×V)-V×(3⍴1)∘.×L"()
+C=apl.Chol(S)
+apl"⌊0.5+1e6×(⍉C)+.×C"()
+X=apl.Solve(S,apl"1 2 3"())
+apl"⌊0.5+1e6×S+.×X"()
+T=apl.Text"héllo wörld"; apl._split=apl.Text
+#T
+T[2]
+tostring(apl"2↓¯3↓T"())
+apl"T='l'"()
+apl"T⍳⊃'wöx'"()
+apl"(⊃'lóö')∊T"()
+apl"⍴⌽T"()
+apl._split=nil
+DM=apl"3 3⍴1 0 0 0 2 0 0 0 3"(); SM=apl.Sparse(DM)
+SM.nnz
+apl.Sparse(DM,0.1)==nil
+apl.Dense(SM)
+apl"⍴SM"()
+apl"+/SM"()
+apl"+⌿SM"()
+apl.Dense(apl"SM+.×SM"())
+apl"DM+.×SM"()
+apl"SM[2;2]"()
+apl"1+SM"()
+apl"SM×2"()
+apl"⌽SM"()
+apl"2↑SM"()
+ND=apl"2 2 2⍴⍳8"()
+apl"⌽ND"()
+apl"ND,9"()
+apl"1⌽ND"()
+apl.Reverse(ND)
+apl"⍴-ND"()
+apl"⍴(⍳3)⍳ND"()
+apl"ND[1;1;1]←99"()
+apl"ND[1;1;1],ND[2;2;2]"()
+apl"ND[2;;]←0"()
+apl",ND"()
+apl"⍴+/2 0 3⍴0"()
+apl"⍴+⌿2 0 3⍴0"()
+csv=os.tmpname(); f=io.open(csv,"w"); f:write("a;b;c\n1;2;3\n\n4;x;6\n"); f:close()
+apl.ReadCSV(csv,";",1)
+apl.Shape(apl.ReadCSV(csv,";",1))
+os.remove(csv)
+csv=os.tmpname(); f=io.open(csv,"w"); f:write("1\n2\n3\n4\n"); f:close(); XS=apl.Stream(csv)
+apl.Chunked("+/XS×XS",2)()
+apl.Chunked("⌈/1+XS÷2",3)()
+apl.Chunked("+/XS×⌽XS",2)()
+apl.Chunked("⌈/+\\XS",2)()
+XS=nil; os.remove(csv)
+select('#',require"apl_core".memory(0))
+MU=apl.Memory()
+MU.used>0 and MU.peak>=MU.used
+apl._memory=MU.used+2^20
+apl._memory-MU.used
+apl"⍴⍳1e7"()
+apl._memory=nil
+apl._memory
+csv=os.tmpname(); f=io.open(csv,"w"); for i=1,1e5 do f:write(i,"\n") end; f:close()
+apl._memory=apl.Memory().used+2^20
+not pcall(apl.ReadCSV,csv)
+apl._memory=nil
+apl.Shape(apl.ReadCSV(csv))
+os.remove(csv)
+function yields(f,...) local co,n,ok,r,t=coroutine.create(f),-1; apl._progress=coroutine.yield; repeat n=n+1; ok,r,t=coroutine.resume(co,...) until not (ok and t); apl._progress=nil; return ok and n or r end
+BIG=apl"⍳200000"()
+yields(apl"⍵×2",BIG)
+yields(apl"+/⍵",BIG)
+yields(apl.Each(function(x) return x+1 end),BIG)
+BIG=nil
+NCALL=0; MSQ=apl.Memo(function(x) NCALL=NCALL+1; return apl"⍵×⍵"(x) end,"msq"); XM=apl"⍳4"()
+MSQ(XM)[4]+MSQ(XM)[4]
+NCALL..","..apl.Memo().functions.msq.hits
+apl.Set(XM,{1},10)
+MSQ(XM)[1]..","..NCALL
+GM=apl"⍳3"(); MG=apl.Memo(function() return GM end)
+MG(1)==GM
+apl.Set(GM,{1},5)
+GM[1]..","..MG(1)[1]
+MEMO=apl._memo; apl._memo=200; MC=apl.Memo(function(x) return {x} end,"mc")
+for i=1,1000 do MC(i) end
+apl.Memo().entries<1000 and apl.Memo().bytes<=200 and apl.Memo().evictions>0
+apl._memo=MEMO; apl.Memo"clear"
+apl.Memo().entries
+_APL_FAST=true; package.loaded.apl=nil; fast=require"apl"; package.loaded.apl=apl; _APL_FAST=nil
+fast"+/⍳4"()
+type(fast._startup)
+fast.help(fast.Memo,0)~=nil
+]]
+
+aplchars = [[! + , . / < = > ? \ § ¨ × ÷ ↑ ↓ ∇ ∊ − ∘ ∣ ∧ ∨ ∼ ≠ ≡ ≤ ≥ ⊂ ⊃ ⊖ ⊤ ⊥ ⋆ ⌈ ⌊ ⌹ ⌽ ⌿ ⍀ ⍉ ⍋ ⍎ ⍒ ⍕ ⍟ ⍪ ⍱ ⍲ ⍳ ⍴ ⎕ ○ ⌸]]
 apl_tally = {}
 lua_tally = {}
 apl_omitted, lua_omitted = {},{}
@@ -129,8 +264,9 @@ for S in tests[_APL_LEVEL]:gmatch"[^\n]+" do
    if S:match"%S" then
       f=apl(S) 
       print('   '..S..' → '..lua(f)) 
-      local res=f()
-      if res then print(tostring(res)) end
+      local ok,res=pcall(f)
+      if not ok then print('ERROR: '..tostring(res))
+      elseif res then print(tostring(res)) end
       for k in aplchars:gmatch"%S+" do
          local c=occurs(S,k)
          if c>0 then             
@@ -148,6 +284,13 @@ for S in tests[_APL_LEVEL]:gmatch"[^\n]+" do
    end
 end
 
+for S in (luatests[_APL_LEVEL] or ""):gmatch"[^\n]+" do
+   local f=load("return "..S) or load(S)
+   local ok,res=pcall(f)
+   if not ok then res='ERROR: '..tostring(res) end
+   print('   '..S..(res~=nil and ' → '..tostring(res) or ''))
+end
+
 t={}
 for k,v in pairs(apl) do if lua_tally[k] then
    t[k..":"..(lua_tally[k] or 0)]=true 